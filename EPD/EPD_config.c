@@ -7,6 +7,7 @@
 
 #define CONFIG_FILE_ID 0x0000
 #define CONFIG_REC_KEY 0x0001
+#define INIT_SEQ_REC_KEY 0x0002
 
 static void fds_evt_handler(fds_evt_t const * const p_fds_evt)
 {
@@ -38,21 +39,21 @@ void epd_config_init(epd_config_t *cfg)
     run_fds_gc(NULL, 0);
 }
 
-void epd_config_read(epd_config_t *cfg)
+static void record_read(uint16_t key, void *data, uint16_t size)
 {
     fds_flash_record_t  flash_record;
     fds_record_desc_t   record_desc;
     fds_find_token_t    ftok;
 
-    memset(cfg, 0xFF, sizeof(epd_config_t));
+    memset(data, 0xFF, size);
     memset(&ftok, 0x00, sizeof(fds_find_token_t));
 
-    if (fds_record_find(CONFIG_FILE_ID, CONFIG_REC_KEY, &record_desc, &ftok) != NRF_SUCCESS) {
-        NRF_LOG_DEBUG("epd_config_load: record not found\n");
+    if (fds_record_find(CONFIG_FILE_ID, key, &record_desc, &ftok) != NRF_SUCCESS) {
+        NRF_LOG_DEBUG("record_read: record %d not found\n", key);
         return;
     }
     if (fds_record_open(&record_desc, &flash_record) != NRF_SUCCESS) {
-        NRF_LOG_ERROR("epd_config_load: record open failed!");
+        NRF_LOG_ERROR("record_read: record %d open failed!", key);
         return;
     }
 #ifdef S112
@@ -60,11 +61,12 @@ void epd_config_read(epd_config_t *cfg)
 #else
     uint32_t record_len = flash_record.p_header->tl.length_words * sizeof(uint32_t);
 #endif
-    memcpy(cfg, flash_record.p_data, MIN(sizeof(epd_config_t), record_len));
+    memcpy(data, flash_record.p_data, MIN(size, record_len));
     fds_record_close(&record_desc);
 }
 
-void epd_config_write(epd_config_t *cfg)
+// data must stay valid until the write has finished, fds only queues it
+static void record_write(uint16_t key, void *data, uint16_t size)
 {
     ret_code_t          ret;
     fds_record_t        record;
@@ -72,41 +74,41 @@ void epd_config_write(epd_config_t *cfg)
     fds_find_token_t    ftok;
 
     record.file_id = CONFIG_FILE_ID;
-    record.key = CONFIG_REC_KEY;
+    record.key = key;
 #ifdef S112
-    record.data.p_data = (void*)cfg;
-    record.data.length_words = BYTES_TO_WORDS(sizeof(epd_config_t));
+    record.data.p_data = data;
+    record.data.length_words = BYTES_TO_WORDS(size);
 #else
     fds_record_chunk_t record_chunk;
-    record_chunk.p_data = cfg;
-    record_chunk.length_words = BYTES_TO_WORDS(sizeof(epd_config_t));
+    record_chunk.p_data = data;
+    record_chunk.length_words = BYTES_TO_WORDS(size);
     record.data.p_chunks = &record_chunk;
     record.data.num_chunks = 1;
 #endif
 
     memset(&ftok, 0x00, sizeof(fds_find_token_t));
-    ret = fds_record_find(CONFIG_FILE_ID, CONFIG_REC_KEY, &record_desc, &ftok);
+    ret = fds_record_find(CONFIG_FILE_ID, key, &record_desc, &ftok);
     if (ret == NRF_SUCCESS)
         ret = fds_record_update(&record_desc, &record);
     else
         ret = fds_record_write(&record_desc, &record);
 
     if (ret != NRF_SUCCESS) {
-        NRF_LOG_ERROR("epd_config_save: record write/update failed, code=%d\n", ret);
+        NRF_LOG_ERROR("record_write: record %d write/update failed, code=%d\n", key, ret);
         if (ret == FDS_ERR_NO_SPACE_IN_FLASH)
             app_sched_event_put(NULL, 0, run_fds_gc);
     }
 }
 
-void epd_config_clear(epd_config_t *cfg)
+static void record_delete(uint16_t key)
 {
     ret_code_t          ret;
     fds_record_desc_t   record_desc;
     fds_find_token_t    ftok;
 
     memset(&ftok, 0x00, sizeof(fds_find_token_t));
-    if (fds_record_find(CONFIG_FILE_ID, CONFIG_REC_KEY, &record_desc, &ftok) != NRF_SUCCESS) {
-        NRF_LOG_DEBUG("epd_config_clear: record not found\n");
+    if (fds_record_find(CONFIG_FILE_ID, key, &record_desc, &ftok) != NRF_SUCCESS) {
+        NRF_LOG_DEBUG("record_delete: record %d not found\n", key);
         return;
     }
 
@@ -116,6 +118,36 @@ void epd_config_clear(epd_config_t *cfg)
     }
 }
 
+void epd_config_read(epd_config_t *cfg)
+{
+    record_read(CONFIG_REC_KEY, cfg, sizeof(epd_config_t));
+}
+
+void epd_config_write(epd_config_t *cfg)
+{
+    record_write(CONFIG_REC_KEY, cfg, sizeof(epd_config_t));
+}
+
+void epd_config_clear(epd_config_t *cfg)
+{
+    record_delete(CONFIG_REC_KEY);
+}
+
+void epd_init_seq_read(epd_init_seq_t *seq)
+{
+    record_read(INIT_SEQ_REC_KEY, seq, sizeof(epd_init_seq_t));
+}
+
+void epd_init_seq_write(epd_init_seq_t *seq)
+{
+    record_write(INIT_SEQ_REC_KEY, seq, sizeof(epd_init_seq_t));
+}
+
+void epd_init_seq_clear(void)
+{
+    record_delete(INIT_SEQ_REC_KEY);
+}
+
 bool epd_config_empty(epd_config_t *cfg)
 {
     for (uint8_t i = 0; i < EPD_CONFIG_SIZE; i++) {
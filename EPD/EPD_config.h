@@ -19,11 +19,25 @@ typedef struct
 } epd_config_t;
 
 #define EPD_CONFIG_SIZE (sizeof(epd_config_t) / sizeof(uint8_t))
-    
+
+#define EPD_INIT_SEQ_MAX 126
+
+// init sequence uploaded by the host, used instead of the built-in one of model_id
+typedef struct
+{
+    uint8_t model_id;
+    uint8_t length;
+    uint8_t data[EPD_INIT_SEQ_MAX];
+} epd_init_seq_t;
+
 void epd_config_init(epd_config_t *cfg);
 void epd_config_read(epd_config_t *cfg);
 void epd_config_write(epd_config_t *cfg);
 void epd_config_clear(epd_config_t *cfg);
 bool epd_config_empty(epd_config_t *cfg);
 
+void epd_init_seq_read(epd_init_seq_t *seq);
+void epd_init_seq_write(epd_init_seq_t *seq);
+void epd_init_seq_clear(void);
+
 #endif
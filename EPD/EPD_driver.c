@@ -12,8 +12,7 @@
 *
 ******************************************************************************/
 
-#include "app_error.h"
-#include "nrf_drv_spi.h"
+#include <string.h>
 #include "EPD_driver.h"
 #include "nrf_log.h"
 
@@ -30,43 +29,45 @@ static uint32_t EPD_BS_PIN = 2;
 static uint32_t EPD_EN_PIN = 7;
 static uint32_t EPD_LED_PIN = 16;
 
-#define SPI_INSTANCE  0 /**< SPI instance index. */
-static const nrf_drv_spi_t spi = NRF_DRV_SPI_INSTANCE(SPI_INSTANCE);  /**< SPI instance. */
-
-#if defined(S112)
-#define HAL_SPI_INSTANCE spi.u.spi.p_reg
+// HAL
+#if defined(EPD_HAL_LINUX)
+static const epd_hal_t *m_hal = &epd_hal_linux;
 #else
-#define HAL_SPI_INSTANCE spi.p_registers
-nrf_gpio_pin_dir_t nrf_gpio_pin_dir_get(uint32_t pin)
+static const epd_hal_t *m_hal = &epd_hal_nrf;
+#endif
+
+void EPD_HAL_Set(const epd_hal_t *hal)
 {
-    NRF_GPIO_Type * reg = nrf_gpio_pin_port_decode(&pin);
-    return (nrf_gpio_pin_dir_t)((reg->PIN_CNF[pin] &
-                                 GPIO_PIN_CNF_DIR_Msk) >> GPIO_PIN_CNF_DIR_Pos);
+    if (hal != NULL) m_hal = hal;
 }
-#endif
+
+// performance counters
+static epd_stats_t m_stats;
 
 // Arduino like function wrappers
 void pinMode(uint32_t pin, uint32_t mode)
 {
-    switch (mode)
-    {
-        case INPUT:
-            nrf_gpio_cfg_input(pin, NRF_GPIO_PIN_NOPULL);
-            break;
-        case INPUT_PULLUP:
-            nrf_gpio_cfg_input(pin, NRF_GPIO_PIN_PULLUP);
-            break;
-        case INPUT_PULLDOWN:
-            nrf_gpio_cfg_input(pin, NRF_GPIO_PIN_PULLDOWN);
-            break;
-        case OUTPUT:
-            nrf_gpio_cfg_output(pin);
-            break;
-        case DEFAULT:
-        default:
-            nrf_gpio_cfg_default(pin);
-            break;
-    }
+    m_hal->pin_mode(pin, mode);
+}
+
+void digitalWrite(uint32_t pin, uint32_t value)
+{
+    m_hal->pin_write(pin, value);
+}
+
+uint32_t digitalRead(uint32_t pin)
+{
+    return m_hal->pin_read(pin);
+}
+
+void delay(uint32_t ms)
+{
+    m_hal->delay_ms(ms);
+}
+
+uint32_t millis(void)
+{
+    return m_hal->millis();
 }
 
 // GPIO
@@ -94,15 +95,7 @@ void EPD_GPIO_Init(void)
     pinMode(EPD_RST_PIN, OUTPUT);
     pinMode(EPD_BUSY_PIN, INPUT);
 
-    nrf_drv_spi_config_t spi_config = NRF_DRV_SPI_DEFAULT_CONFIG;
-    spi_config.sck_pin = EPD_SCLK_PIN;
-    spi_config.mosi_pin = EPD_MOSI_PIN;
-    spi_config.ss_pin = EPD_CS_PIN;
-#if defined(S112)
-    APP_ERROR_CHECK(nrf_drv_spi_init(&spi, &spi_config, NULL, NULL));
-#else
-    APP_ERROR_CHECK(nrf_drv_spi_init(&spi, &spi_config, NULL));
-#endif
+    m_hal->spi_init(EPD_SCLK_PIN, EPD_MOSI_PIN, EPD_CS_PIN);
 
     if (EPD_BS_PIN != 0xFF) {
         pinMode(EPD_BS_PIN, OUTPUT);
@@ -116,10 +109,11 @@ void EPD_GPIO_Init(void)
     digitalWrite(EPD_DC_PIN, LOW);
     digitalWrite(EPD_RST_PIN, HIGH);
 
-    if (EPD_LED_PIN != 0xFF)
+    // the LED shows the BLE connection, it is not turned on for panel updates
+    if (EPD_LED_PIN != 0xFF) {
         pinMode(EPD_LED_PIN, OUTPUT);
-
-    EPD_LED_ON();
+        EPD_LED_OFF();
+    }
 }
 
 void EPD_GPIO_Uninit(void)
@@ -128,7 +122,7 @@ void EPD_GPIO_Uninit(void)
 
     EPD_LED_OFF();
 
-    nrf_drv_spi_uninit(&spi);
+    m_hal->spi_uninit();
 
     digitalWrite(EPD_DC_PIN, LOW);
     digitalWrite(EPD_CS_PIN, LOW);
@@ -149,24 +143,15 @@ void EPD_GPIO_Uninit(void)
 }
 
 // SPI
-void EPD_SPI_WriteBytes(uint8_t *value, uint8_t len)
+void EPD_SPI_WriteBytes(uint8_t *value, uint16_t len)
 {
-    nrf_gpio_pin_dir_t dir = nrf_gpio_pin_dir_get(EPD_MOSI_PIN);
-    if (dir != NRF_GPIO_PIN_DIR_OUTPUT) {
-        pinMode(EPD_MOSI_PIN, OUTPUT);
-        nrf_spi_pins_set(HAL_SPI_INSTANCE, EPD_SCLK_PIN, EPD_MOSI_PIN, NRF_SPI_PIN_NOT_CONNECTED);
-    }
-    APP_ERROR_CHECK(nrf_drv_spi_transfer(&spi, value, len, NULL, 0));
+    m_stats.spi_bytes += len;
+    m_hal->spi_write(value, len);
 }
 
-void EPD_SPI_ReadBytes(uint8_t *value, uint8_t len)
+void EPD_SPI_ReadBytes(uint8_t *value, uint16_t len)
 {
-    nrf_gpio_pin_dir_t dir = nrf_gpio_pin_dir_get(EPD_MOSI_PIN);
-    if (dir != NRF_GPIO_PIN_DIR_INPUT) {
-        pinMode(EPD_MOSI_PIN, INPUT);
-        nrf_spi_pins_set(HAL_SPI_INSTANCE, EPD_SCLK_PIN, NRF_SPI_PIN_NOT_CONNECTED, EPD_MOSI_PIN);
-    }
-    APP_ERROR_CHECK(nrf_drv_spi_transfer(&spi, NULL, 0, value, len));
+    m_hal->spi_read(value, len);
 }
 
 void EPD_SPI_WriteByte(uint8_t value)
@@ -184,6 +169,7 @@ uint8_t EPD_SPI_ReadByte(void)
 // EPD
 void EPD_WriteCommand(uint8_t Reg)
 {
+    m_stats.commands++;
     digitalWrite(EPD_DC_PIN, LOW);
     EPD_SPI_WriteByte(Reg);
 }
@@ -194,18 +180,43 @@ void EPD_WriteByte(uint8_t Data)
     EPD_SPI_WriteByte(Data);
 }
 
-void EPD_WriteData(uint8_t *Data, uint8_t Len)
+void EPD_WriteData(uint8_t *Data, uint16_t Len)
 {
     digitalWrite(EPD_DC_PIN, HIGH);
     EPD_SPI_WriteBytes(Data, Len);
 }
 
+// write the same byte Len times
+void EPD_FillData(uint8_t Data, uint16_t Len)
+{
+    digitalWrite(EPD_DC_PIN, HIGH);
+    m_stats.spi_bytes += Len;
+    m_hal->spi_fill(Data, Len);
+}
+
 uint8_t EPD_ReadByte(void)
 {
     digitalWrite(EPD_DC_PIN, HIGH);
     return EPD_SPI_ReadByte();
 }
 
+void EPD_ReadData(uint8_t *Data, uint16_t Len)
+{
+    digitalWrite(EPD_DC_PIN, HIGH);
+    EPD_SPI_ReadBytes(Data, Len);
+}
+
+// CRC-16/CCITT-FALSE, start with crc = 0xFFFF
+uint16_t EPD_CRC16(uint16_t crc, const uint8_t *data, uint16_t len)
+{
+    while (len--) {
+        crc ^= (uint16_t)*data++ << 8;
+        for (uint8_t i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+    return crc;
+}
+
 void EPD_Reset(uint32_t value, uint16_t duration)
 {
     digitalWrite(EPD_RST_PIN, value);
@@ -216,27 +227,57 @@ void EPD_Reset(uint32_t value, uint16_t duration)
     delay(duration);
 }
 
-void EPD_WaitBusy(uint32_t value, uint16_t timeout)
+// BUSY
+static uint32_t m_busy_start;
+static epd_callback_t m_busy_callback = NULL;
+static void *m_busy_context = NULL;
+
+static void busy_stats_update(uint32_t elapsed)
+{
+    m_stats.busy_count++;
+    m_stats.busy_total_ms += elapsed;
+    if (elapsed > m_stats.busy_max_ms) m_stats.busy_max_ms = elapsed;
+}
+
+uint32_t EPD_WaitBusy(uint32_t value, uint16_t timeout)
 {
-    uint32_t led_status = digitalRead(EPD_LED_PIN);
+    uint32_t start = millis();
 
     NRF_LOG_DEBUG("[EPD]: check busy\n");
-    while (digitalRead(EPD_BUSY_PIN) == value) {
-        if (timeout % 100 == 0) EPD_LED_Toggle();
-        delay(1);
-        timeout--;
-        if (timeout == 0) {
-            NRF_LOG_DEBUG("[EPD]: busy timeout!\n");
-            break;
-        }
-    }
-    NRF_LOG_DEBUG("[EPD]: busy release\n");
+    if (!m_hal->busy_wait(EPD_BUSY_PIN, value, timeout))
+        NRF_LOG_DEBUG("[EPD]: busy timeout!\n");
 
-    // restore led status
-    if (led_status == LOW)
-        EPD_LED_ON();
-    else
-        EPD_LED_OFF();
+    uint32_t elapsed = millis() - start;
+    NRF_LOG_DEBUG("[EPD]: busy release, %d ms\n", elapsed);
+    busy_stats_update(elapsed);
+    return elapsed;
+}
+
+static void busy_async_handler(bool timeout)
+{
+    if (timeout) NRF_LOG_DEBUG("[EPD]: busy timeout!\n");
+
+    uint32_t elapsed = millis() - m_busy_start;
+    NRF_LOG_DEBUG("[EPD]: busy release, %d ms\n", elapsed);
+    busy_stats_update(elapsed);
+
+    epd_callback_t callback = m_busy_callback;
+    m_busy_callback = NULL;
+    if (callback) callback(m_busy_context, elapsed);
+}
+
+void EPD_WaitBusyAsync(uint32_t value, uint16_t timeout, epd_callback_t callback, void *p_context)
+{
+    NRF_LOG_DEBUG("[EPD]: check busy (async)\n");
+    m_busy_start = millis();
+    m_busy_callback = callback;
+    m_busy_context = p_context;
+    m_hal->busy_wait_async(EPD_BUSY_PIN, value, timeout, busy_async_handler);
+}
+
+bool EPD_IsBusyWaiting(void)
+{
+    return m_busy_callback != NULL;
 }
 
 // lED
@@ -255,7 +296,7 @@ void EPD_LED_OFF(void)
 void EPD_LED_Toggle(void)
 {
     if (EPD_LED_PIN != 0xFF)
-        nrf_gpio_pin_toggle(EPD_LED_PIN);
+        digitalWrite(EPD_LED_PIN, !m_hal->pin_out_read(EPD_LED_PIN));
 }
 
 void EPD_LED_BLINK(void)
@@ -270,49 +311,126 @@ void EPD_LED_BLINK(void)
     }
 }
 
-float EPD_ReadVoltage(void)
-{
-#if defined(S112)
-    volatile int16_t value = 0;
-    NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_10bit;
-    NRF_SAADC->ENABLE = (SAADC_ENABLE_ENABLE_Enabled << SAADC_ENABLE_ENABLE_Pos);
-    NRF_SAADC->CH[0].CONFIG = ((SAADC_CH_CONFIG_RESP_Bypass     << SAADC_CH_CONFIG_RESP_Pos)   & SAADC_CH_CONFIG_RESP_Msk)
-                            | ((SAADC_CH_CONFIG_RESP_Bypass     << SAADC_CH_CONFIG_RESN_Pos)   & SAADC_CH_CONFIG_RESN_Msk)
-                            | ((SAADC_CH_CONFIG_GAIN_Gain1_6    << SAADC_CH_CONFIG_GAIN_Pos)   & SAADC_CH_CONFIG_GAIN_Msk)
-                            | ((SAADC_CH_CONFIG_REFSEL_Internal << SAADC_CH_CONFIG_REFSEL_Pos) & SAADC_CH_CONFIG_REFSEL_Msk)
-                            | ((SAADC_CH_CONFIG_TACQ_3us        << SAADC_CH_CONFIG_TACQ_Pos)   & SAADC_CH_CONFIG_TACQ_Msk)
-                            | ((SAADC_CH_CONFIG_MODE_SE         << SAADC_CH_CONFIG_MODE_Pos)   & SAADC_CH_CONFIG_MODE_Msk);
-    NRF_SAADC->CH[0].PSELN = SAADC_CH_PSELN_PSELN_NC;
-    NRF_SAADC->CH[0].PSELP = SAADC_CH_PSELP_PSELP_VDD;
-    NRF_SAADC->RESULT.PTR = (uint32_t)&value;
-    NRF_SAADC->RESULT.MAXCNT = 1;
-    NRF_SAADC->TASKS_START = 0x01UL;
-    while (!NRF_SAADC->EVENTS_STARTED);
-    NRF_SAADC->EVENTS_STARTED = 0x00UL;
-    NRF_SAADC->TASKS_SAMPLE = 0x01UL;
-    while (!NRF_SAADC->EVENTS_END);
-    NRF_SAADC->EVENTS_END = 0x00UL;
-    NRF_SAADC->TASKS_STOP = 0x01UL;
-    while (!NRF_SAADC->EVENTS_STOPPED);
-    NRF_SAADC->EVENTS_STOPPED = 0x00UL;
-    if (value < 0) value = 0;
-    NRF_SAADC->ENABLE = (SAADC_ENABLE_ENABLE_Disabled << SAADC_ENABLE_ENABLE_Pos);
-#else
-    NRF_ADC->ENABLE = 1;
-    NRF_ADC->CONFIG = (ADC_CONFIG_RES_10bit << ADC_CONFIG_RES_Pos) |
-                      (ADC_CONFIG_INPSEL_SupplyOneThirdPrescaling << ADC_CONFIG_INPSEL_Pos) |
-                      (ADC_CONFIG_REFSEL_VBG << ADC_CONFIG_REFSEL_Pos) |
-                      (ADC_CONFIG_PSEL_Disabled << ADC_CONFIG_PSEL_Pos) |
-                      (ADC_CONFIG_EXTREFSEL_None << ADC_CONFIG_EXTREFSEL_Pos);
-    NRF_ADC->TASKS_START = 1;
-    while(!NRF_ADC->EVENTS_END);
-    NRF_ADC->EVENTS_END = 0;
-    uint16_t value = NRF_ADC->RESULT;
-    NRF_ADC->TASKS_STOP = 1;
-    NRF_ADC->ENABLE = 0;
-#endif
-    NRF_LOG_DEBUG("ADC value: %d\n", value);
-    return (value * 3.6) / (1 << 10);
+// VDD is sampled in background, readers only get the cached value
+static uint16_t m_vdd_mv = 0;
+static uint32_t m_vdd_timestamp = 0;
+
+void EPD_VoltageSample(void)
+{
+    m_vdd_mv = m_hal->read_voltage();
+    m_vdd_timestamp = millis();
+    NRF_LOG_DEBUG("[EPD]: VDD %d mV\n", m_vdd_mv);
+}
+
+// VDD in mV, sampled on first use if the background sampler hasn't run yet
+uint16_t EPD_ReadVoltage(void)
+{
+    if (m_vdd_mv == 0) EPD_VoltageSample();
+    return m_vdd_mv;
+}
+
+// millis() of the cached sample
+uint32_t EPD_VoltageTimestamp(void)
+{
+    return m_vdd_timestamp;
+}
+
+// Run an init sequence: EPD_SEQ_CMD(n) entries are sent as one command
+// and one n byte data transfer, the other opcodes take one parameter byte.
+void EPD_RunSequence(const uint8_t *seq)
+{
+    while (*seq != EPD_SEQ_END) {
+        uint8_t op = *seq++;
+        uint8_t param = *seq++;
+        if (op < EPD_SEQ_DELAY) {
+            EPD_WriteCommand(param);
+            if (op > 0) EPD_WriteData((uint8_t *)seq, op);
+            seq += op;
+        } else if (op == EPD_SEQ_DELAY) {
+            delay(param);
+        } else if (op == EPD_SEQ_BUSY) {
+            EPD_WaitBusy(epd_get()->drv->busy_value, param * 10);
+        } else if (op == EPD_SEQ_RESET) {
+            EPD_Reset(HIGH, param);
+        } else {
+            NRF_LOG_DEBUG("[EPD]: bad init opcode %02x\n", op);
+            return;
+        }
+    }
+}
+
+// check an uploaded sequence: known opcodes only, BUSY waits with a
+// timeout and terminated within len
+bool EPD_SequenceValid(const uint8_t *seq, uint16_t len)
+{
+    uint16_t i = 0;
+    while (i < len && seq[i] != EPD_SEQ_END) {
+        uint8_t op = seq[i];
+        if (op > EPD_SEQ_RESET) return false;
+        if (op == EPD_SEQ_BUSY && (i + 1 >= len || seq[i + 1] == 0)) return false;
+        i += 2 + (op < EPD_SEQ_DELAY ? op : 0);
+    }
+    return i < len;
+}
+
+// first data byte of cmd in the sequence, -1 if not found
+int16_t EPD_SequenceParam(const uint8_t *seq, uint8_t cmd)
+{
+    while (*seq != EPD_SEQ_END) {
+        uint8_t op = seq[0];
+        if (op > 0 && op < EPD_SEQ_DELAY && seq[1] == cmd) return seq[2];
+        seq += 2 + (op < EPD_SEQ_DELAY ? op : 0);
+    }
+    return -1;
+}
+
+// sequence uploaded by the host, replaces the built-in one of a model
+static epd_model_id_t m_init_seq_id;
+static const uint8_t *m_init_seq = NULL;
+
+void EPD_SetInitSequence(epd_model_id_t id, const uint8_t *seq)
+{
+    m_init_seq_id = id;
+    m_init_seq = seq;
+}
+
+const uint8_t *EPD_InitSequence(void)
+{
+    epd_model_t *epd = epd_get();
+    return (m_init_seq != NULL && m_init_seq_id == epd->id) ? m_init_seq : epd->init_seq;
+}
+
+// the sensor read runs a controller sequence and waits on BUSY, so one
+// reading is shared by the GUI and the waveform selection
+static int8_t m_temp;
+static bool m_temp_valid = false;
+static uint32_t m_temp_timestamp;
+
+// panel temperature, read from the controller if the cache is older than EPD_TEMP_MAX_AGE
+int8_t EPD_ReadTemp(void)
+{
+    if (!m_temp_valid || millis() - m_temp_timestamp > EPD_TEMP_MAX_AGE) {
+        m_temp = epd_get()->drv->read_temp();
+        m_temp_timestamp = millis();
+        m_temp_valid = true;
+        NRF_LOG_DEBUG("[EPD]: temperature: %d\n", m_temp);
+    }
+    return m_temp;
+}
+
+void EPD_TempInvalidate(void)
+{
+    m_temp_valid = false;
+}
+
+epd_stats_t *EPD_Stats(void)
+{
+    return &m_stats;
+}
+
+void EPD_StatsReset(void)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
 }
 
 // EPD models
@@ -338,14 +456,54 @@ epd_model_t *epd_get(void)
     return EPD == NULL ? epd_models[0] : EPD;
 }
 
+static epd_callback_t m_refresh_callback = NULL;
+static void *m_refresh_context = NULL;
+static epd_refresh_mode_t m_refresh_mode;
+
+static void epd_refresh_done(void *p_context, uint32_t elapsed)
+{
+    if (m_refresh_mode == EPD_REFRESH_FULL)
+        m_stats.refresh_full_ms = elapsed;
+    else if (m_refresh_mode == EPD_REFRESH_FAST)
+        m_stats.refresh_fast_ms = elapsed;
+    NRF_LOG_DEBUG("[EPD]: refresh mode %d done in %d ms\n", m_refresh_mode, elapsed);
+    epd_get()->drv->refresh_end();
+    EPD_GPIO_Uninit();
+
+    epd_callback_t callback = m_refresh_callback;
+    m_refresh_callback = NULL;
+    if (callback) callback(m_refresh_context, elapsed);
+}
+
+void epd_refresh_async(epd_refresh_mode_t mode, epd_callback_t callback, void *p_context)
+{
+    epd_model_t *epd = epd_get();
+
+    m_refresh_callback = callback;
+    m_refresh_context = p_context;
+    m_refresh_mode = mode;
+
+    m_stats.refresh_count++;
+    EPD_GPIO_Init(); // keep SPI alive until refresh_end even if the peer disconnects
+    epd->drv->refresh_start(mode);
+    EPD_WaitBusyAsync(epd->drv->busy_value, 30000, epd_refresh_done, NULL);
+}
+
+bool epd_refresh_busy(void)
+{
+    return EPD_IsBusyWaiting();
+}
+
 epd_model_t *epd_init(epd_model_id_t id)
 {
+    epd_model_t *prev = EPD;
     for (uint8_t i = 0; i < ARRAY_SIZE(epd_models); i++) {
         if (epd_models[i]->id == id) {
             EPD = epd_models[i];
         }
     }
     if (EPD == NULL) EPD = epd_models[0];
+    if (EPD != prev) EPD_TempInvalidate();
     EPD->drv->init();
     return EPD;
 }
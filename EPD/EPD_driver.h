@@ -18,12 +18,41 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include "nrf_delay.h"
-#include "nrf_gpio.h"
 #include "EPD_config.h"
+#include "EPD_hal.h"
 
 #define BIT(n)  (1UL << (n))
 
+// init sequence opcodes, see EPD_RunSequence
+#define EPD_SEQ_CMD(n)  (n)                           /**< command and n data bytes follow, n < 0x40 */
+#define EPD_SEQ_DELAY   0x40                          /**< delay, ms follows */
+#define EPD_SEQ_BUSY    0x41                          /**< wait for BUSY, timeout in 10 ms units follows */
+#define EPD_SEQ_RESET   0x42                          /**< hardware reset, ms to wait after it follows */
+#define EPD_SEQ_END     0xFF                          /**< end of sequence */
+
+#ifndef EPD_TEMP_MAX_AGE
+#define EPD_TEMP_MAX_AGE 600000                       /**< Milliseconds a panel temperature reading is reused */
+#endif
+
+typedef enum
+{
+    EPD_REFRESH_FULL = 0,                             /**< Full refresh with the OTP waveform */
+    EPD_REFRESH_PARTIAL = 1,                          /**< Fast black/white refresh */
+    EPD_REFRESH_FAST = 2,                             /**< Full screen black/white refresh with the driver LUT, falls back to full */
+    EPD_REFRESH_DIFF = 3,                             /**< Drive only the pixels changed since the previous frame, falls back to full */
+    EPD_REFRESH_GRAY = 4,                             /**< 4 gray levels, RAM1/RAM2 hold the high/low bit plane, falls back to full */
+} epd_refresh_mode_t;
+
+typedef enum
+{
+    EPD_COLOR_BLACK = 0,
+    EPD_COLOR_WHITE = 1,
+    EPD_COLOR_RED = 2,                                /**< Black on B/W panels */
+} epd_color_t;
+
+/**@brief Completion callback, elapsed is the BUSY wait time in ms. */
+typedef void (*epd_callback_t)(void *p_context, uint32_t elapsed);
+
 /**@brief EPD driver structure.
  *
  * @details This structure contains epd driver functions.
@@ -34,15 +63,40 @@ typedef struct
     void (*clear)(bool refresh);                      /**< Clear screen */
     void (*write_image)(uint8_t *black, uint8_t *color, uint16_t x, uint16_t y, uint16_t w, uint16_t h); /**< write image */
     void (*refresh)(void);                            /**< Sends the image buffer in RAM to e-Paper and displays */
+    void (*refresh_start)(epd_refresh_mode_t mode);   /**< Start refresh, returns without waiting for BUSY */
+    void (*refresh_end)(void);                        /**< Finish refresh after BUSY is released */
     void (*sleep)(void);                              /**< Enter sleep mode */
     int8_t (*read_temp)(void);                        /**< Read temperature from driver chip */
     void (*force_temp)(int8_t value);                 /**< Force temperature (will trigger OTP LUT switch) */
-    void (*write_partial_image)(uint8_t *black, uint16_t x, uint16_t y, uint16_t w, uint16_t h); /**< write partial image */
-    void (*partial_refresh)(uint16_t x, uint16_t y, uint16_t w, uint16_t h); /**< partial refresh */
+    void (*write_partial_image)(uint8_t *black, uint16_t x, uint16_t y, uint16_t w, uint16_t h); /**< write partial image, all windows written before a EPD_REFRESH_PARTIAL refresh are shown by one activation */
+    void (*partial_refresh)(uint16_t x, uint16_t y, uint16_t w, uint16_t h); /**< partial refresh of the area and the windows written before, waits for BUSY */
+    void (*fill_rect)(uint16_t x, uint16_t y, uint16_t w, uint16_t h, epd_color_t color); /**< fill an area of the RAM with one color */
+    uint16_t (*ram_checksum)(bool red, uint16_t y, uint16_t h); /**< EPD_CRC16 of full width RAM rows read back from the panel */
+    void (*write_window)(uint16_t x, uint16_t y, uint16_t w, uint16_t h, bool red); /**< select a RAM window, image data written next fills it, EPD_REFRESH_PARTIAL shows it */
+    void (*write_window_end)(void);                   /**< leave the write_window window, later RAM writes cover the whole screen again */
+    void (*write_ram)(bool red);                      /**< start a full screen RAM write, optional, cmd_write_ram1/2 are sent when NULL */
     uint8_t cmd_write_ram1;                           /**< Command to write black ram */
     uint8_t cmd_write_ram2;                           /**< Command to write red ram */
+    uint8_t busy_value;                               /**< BUSY pin level while the controller is busy */
+    bool sleep_keeps_ram;                             /**< RAM survives sleep, reset and init while the panel stays powered */
 } epd_driver_t;
 
+/**@brief Driver performance counters, sent to the host as is (little endian). */
+typedef struct
+{
+    uint32_t spi_bytes;                               /**< Bytes written over SPI */
+    uint32_t commands;                                /**< Commands sent */
+    uint32_t busy_count;                              /**< Number of BUSY waits */
+    uint32_t busy_total_ms;                           /**< Total time spent waiting on BUSY */
+    uint32_t busy_max_ms;                             /**< Longest BUSY wait */
+    uint32_t refresh_count;                           /**< Number of display refreshes */
+    uint32_t gui_update_ms;                           /**< Total time spent in full GUI updates */
+    uint32_t gui_part_update_ms;                      /**< Total time spent in partial GUI updates */
+    uint32_t refresh_full_ms;                         /**< Latency of the last OTP waveform refresh */
+    uint32_t refresh_fast_ms;                         /**< Latency of the last fast LUT refresh */
+    uint32_t rx_buf_max;                              /**< High-water mark of the BLE receive buffer in bytes */
+} epd_stats_t;
+
 typedef enum
 {
     EPD_UC8176_420_BW = 1,
@@ -59,6 +113,7 @@ typedef struct
     uint16_t width;
     uint16_t height;
     bool bwr;
+    const uint8_t *init_seq;                          /**< init sequence, see EPD_RunSequence */
 } epd_model_t;
 
 #define LOW             (0x0)
@@ -72,9 +127,13 @@ typedef struct
 
 // Arduino like function wrappers
 void pinMode(uint32_t pin, uint32_t mode);
-#define digitalWrite(pin, value) nrf_gpio_pin_write(pin, value)
-#define digitalRead(pin) nrf_gpio_pin_read(pin)
-#define delay(ms) nrf_delay_ms(ms)
+void digitalWrite(uint32_t pin, uint32_t value);
+uint32_t digitalRead(uint32_t pin);
+void delay(uint32_t ms);
+uint32_t millis(void);
+
+// HAL
+void EPD_HAL_Set(const epd_hal_t *hal);
 
 // GPIO
 void EPD_GPIO_Load(epd_config_t *cfg);
@@ -82,18 +141,23 @@ void EPD_GPIO_Init(void);
 void EPD_GPIO_Uninit(void);
 
 // SPI
-void EPD_SPI_WriteBytes(uint8_t *value, uint8_t len);
-void EPD_SPI_ReadBytes(uint8_t *value, uint8_t len);
+void EPD_SPI_WriteBytes(uint8_t *value, uint16_t len);
+void EPD_SPI_ReadBytes(uint8_t *value, uint16_t len);
 void EPD_SPI_WriteByte(uint8_t value);
 uint8_t EPD_SPI_ReadByte(void);
 
 // EPD
 void EPD_WriteCommand(uint8_t Reg);
 void EPD_WriteByte(uint8_t Data);
-void EPD_WriteData(uint8_t *Data, uint8_t Len);
+void EPD_WriteData(uint8_t *Data, uint16_t Len);
+void EPD_FillData(uint8_t Data, uint16_t Len);
 uint8_t EPD_ReadByte(void);
+void EPD_ReadData(uint8_t *Data, uint16_t Len);
+uint16_t EPD_CRC16(uint16_t crc, const uint8_t *data, uint16_t len);
 void EPD_Reset(uint32_t value, uint16_t duration);
-void EPD_WaitBusy(uint32_t value, uint16_t timeout);
+uint32_t EPD_WaitBusy(uint32_t value, uint16_t timeout);
+void EPD_WaitBusyAsync(uint32_t value, uint16_t timeout, epd_callback_t callback, void *p_context);
+bool EPD_IsBusyWaiting(void);
 
 // LED
 void EPD_LED_ON(void);
@@ -102,9 +166,28 @@ void EPD_LED_Toggle(void);
 void EPD_LED_BLINK(void);
 
 // VDD voltage
-float EPD_ReadVoltage(void);
+void EPD_VoltageSample(void);
+uint16_t EPD_ReadVoltage(void);
+uint32_t EPD_VoltageTimestamp(void);
+
+// Init sequence
+void EPD_RunSequence(const uint8_t *seq);
+bool EPD_SequenceValid(const uint8_t *seq, uint16_t len);
+int16_t EPD_SequenceParam(const uint8_t *seq, uint8_t cmd);
+void EPD_SetInitSequence(epd_model_id_t id, const uint8_t *seq);
+const uint8_t *EPD_InitSequence(void);
+
+// Panel temperature
+int8_t EPD_ReadTemp(void);
+void EPD_TempInvalidate(void);
+
+// Performance counters
+epd_stats_t *EPD_Stats(void);
+void EPD_StatsReset(void);
 
 epd_model_t *epd_get(void);
 epd_model_t *epd_init(epd_model_id_t id);
+void epd_refresh_async(epd_refresh_mode_t mode, epd_callback_t callback, void *p_context);
+bool epd_refresh_busy(void);
 
 #endif
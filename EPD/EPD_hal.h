@@ -0,0 +1,45 @@
+#ifndef __EPD_HAL_H
+#define __EPD_HAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**@brief Called in main context when an async BUSY wait has finished. */
+typedef void (*epd_hal_busy_handler_t)(bool timeout);
+
+/**@brief EPD hardware abstraction layer.
+ *
+ * @details This structure contains the platform functions used by the EPD drivers,
+ *          so the panel drivers can run on other targets than nRF5x.
+ */
+typedef struct
+{
+    void (*pin_mode)(uint32_t pin, uint32_t mode);   /**< Configure pin, see INPUT/OUTPUT/DEFAULT */
+    void (*pin_write)(uint32_t pin, uint32_t value); /**< Set output level */
+    uint32_t (*pin_read)(uint32_t pin);               /**< Read input level */
+    uint32_t (*pin_out_read)(uint32_t pin);           /**< Read back output level */
+    void (*spi_init)(uint32_t sclk_pin, uint32_t mosi_pin, uint32_t cs_pin); /**< Init 3-wire SPI */
+    void (*spi_uninit)(void);                         /**< Release SPI */
+    void (*spi_write)(uint8_t *data, uint16_t len);   /**< Write bytes, returns when done */
+    void (*spi_fill)(uint8_t value, uint16_t len);    /**< Write the same byte len times */
+    void (*spi_read)(uint8_t *data, uint16_t len);    /**< Read bytes, returns when done */
+    void (*delay_ms)(uint32_t ms);                    /**< Busy delay */
+    uint32_t (*millis)(void);                         /**< Milliseconds since boot */
+    bool (*busy_wait)(uint32_t pin, uint32_t value, uint16_t timeout); /**< Wait while pin == value, false on timeout */
+    void (*busy_wait_async)(uint32_t pin, uint32_t value, uint16_t timeout, epd_hal_busy_handler_t handler); /**< Same as busy_wait, without blocking */
+    uint16_t (*read_voltage)(void);                   /**< Read VDD in mV, averaged over several samples */
+} epd_hal_t;
+
+#if defined(EPD_HAL_LINUX)
+extern const epd_hal_t epd_hal_linux;
+#else
+extern const epd_hal_t epd_hal_nrf;
+
+/**@brief Reference counted nrf_drv_gpiote init/uninit, GPIOTE is shared by
+ *        the BUSY wait and the wakeup pin.
+ */
+void epd_hal_gpiote_acquire(void);
+void epd_hal_gpiote_release(void);
+#endif
+
+#endif
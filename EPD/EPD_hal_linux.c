@@ -0,0 +1,226 @@
+/* Linux backend of the EPD hardware abstraction layer
+ *
+ * Records the SPI command/data stream instead of driving real pins, time is
+ * simulated so a full refresh runs in a few milliseconds on the host.
+ */
+
+#include <string.h>
+#include "EPD_driver.h"
+#include "EPD_hal_linux.h"
+
+#define PIN_COUNT 256
+
+static uint8_t m_pin_level[PIN_COUNT];
+static uint32_t m_dc_pin = 0xFF;
+static uint32_t m_busy_pin = 0xFF;
+static uint32_t m_busy_value = HIGH;
+static uint32_t m_busy_cmd_ms[256];
+static struct {
+    uint8_t cmd, param_cmd, mask;
+    uint32_t ms;
+} m_busy_param;
+static struct {
+    uint8_t cmd, param_cmd, value;
+    uint32_t ms;
+} m_busy_value_rule;
+static uint8_t m_last_cmd;
+static uint8_t m_last_data[256];  // last data byte written after each command
+static uint8_t m_read_value = 25;
+
+static uint32_t m_now = 0;        // simulated clock
+static uint32_t m_busy_until = 0; // BUSY is active until this time
+
+static epd_hal_linux_stats_t m_stats;
+static FILE *m_trace = NULL;
+static uint32_t m_trace_data = 0; // data bytes since the last command
+
+static void trace_flush(void)
+{
+    if (m_trace && m_trace_data > 0)
+        fprintf(m_trace, "  data %u bytes\n", m_trace_data);
+    m_trace_data = 0;
+}
+
+static void on_byte(uint8_t value)
+{
+    if (m_pin_level[m_dc_pin] == LOW) {
+        trace_flush();
+        if (m_trace) fprintf(m_trace, "cmd 0x%02X @%u ms\n", value, m_now);
+        m_stats.commands++;
+        m_last_cmd = value;
+        if (m_busy_value_rule.ms > 0 && value == m_busy_value_rule.cmd &&
+            m_last_data[m_busy_value_rule.param_cmd] == m_busy_value_rule.value)
+            m_busy_until = m_now + m_busy_value_rule.ms;
+        else if (m_busy_param.ms > 0 && value == m_busy_param.cmd &&
+            (m_last_data[m_busy_param.param_cmd] & m_busy_param.mask))
+            m_busy_until = m_now + m_busy_param.ms;
+        else if (m_busy_cmd_ms[value] > 0)
+            m_busy_until = m_now + m_busy_cmd_ms[value];
+    } else {
+        m_last_data[m_last_cmd] = value;
+        m_trace_data++;
+        m_stats.data_bytes++;
+    }
+}
+
+// GPIO
+static void hal_pin_mode(uint32_t pin, uint32_t mode)
+{
+}
+
+static void hal_pin_write(uint32_t pin, uint32_t value)
+{
+    if (pin < PIN_COUNT) m_pin_level[pin] = value ? HIGH : LOW;
+}
+
+static uint32_t hal_pin_read(uint32_t pin)
+{
+    if (pin == m_busy_pin)
+        return m_now < m_busy_until ? m_busy_value : !m_busy_value;
+    return pin < PIN_COUNT ? m_pin_level[pin] : LOW;
+}
+
+static uint32_t hal_pin_out_read(uint32_t pin)
+{
+    return pin < PIN_COUNT ? m_pin_level[pin] : LOW;
+}
+
+// Timer
+static void hal_delay(uint32_t ms)
+{
+    m_now += ms;
+    m_stats.delay_ms += ms;
+}
+
+static uint32_t hal_millis(void)
+{
+    return m_now;
+}
+
+// SPI
+static void hal_spi_init(uint32_t sclk_pin, uint32_t mosi_pin, uint32_t cs_pin)
+{
+}
+
+static void hal_spi_uninit(void)
+{
+    trace_flush();
+}
+
+static void hal_spi_write(uint8_t *data, uint16_t len)
+{
+    m_stats.transactions++;
+    while (len--) on_byte(*data++);
+}
+
+static void hal_spi_fill(uint8_t value, uint16_t len)
+{
+    m_stats.transactions++;
+    while (len--) on_byte(value);
+}
+
+static void hal_spi_read(uint8_t *data, uint16_t len)
+{
+    m_stats.transactions++;
+    m_stats.read_bytes += len;
+    memset(data, m_read_value, len);
+}
+
+// BUSY
+static bool hal_busy_wait(uint32_t pin, uint32_t value, uint16_t timeout)
+{
+    m_stats.busy_waits++;
+    if (hal_pin_read(pin) != value) return true;
+
+    uint32_t wait = m_busy_until - m_now;
+    bool ok = wait <= timeout;
+    if (!ok) wait = timeout;
+    m_now += wait;
+    m_stats.busy_ms += wait;
+    return ok;
+}
+
+static void hal_busy_wait_async(uint32_t pin, uint32_t value, uint16_t timeout, epd_hal_busy_handler_t handler)
+{
+    bool ok = hal_busy_wait(pin, value, timeout);
+    if (handler) handler(!ok);
+}
+
+static uint16_t hal_read_voltage(void)
+{
+    return 3000;
+}
+
+const epd_hal_t epd_hal_linux = {
+    .pin_mode = hal_pin_mode,
+    .pin_write = hal_pin_write,
+    .pin_read = hal_pin_read,
+    .pin_out_read = hal_pin_out_read,
+    .spi_init = hal_spi_init,
+    .spi_uninit = hal_spi_uninit,
+    .spi_write = hal_spi_write,
+    .spi_fill = hal_spi_fill,
+    .spi_read = hal_spi_read,
+    .delay_ms = hal_delay,
+    .millis = hal_millis,
+    .busy_wait = hal_busy_wait,
+    .busy_wait_async = hal_busy_wait_async,
+    .read_voltage = hal_read_voltage,
+};
+
+void epd_hal_linux_init(epd_config_t *cfg, uint32_t busy_value)
+{
+    m_dc_pin = cfg->dc_pin;
+    m_busy_pin = cfg->busy_pin;
+    m_busy_value = busy_value;
+    m_busy_until = 0;
+    memset(m_busy_cmd_ms, 0, sizeof(m_busy_cmd_ms));
+    memset(&m_busy_param, 0, sizeof(m_busy_param));
+    memset(&m_busy_value_rule, 0, sizeof(m_busy_value_rule));
+    memset(m_last_data, 0, sizeof(m_last_data));
+    EPD_GPIO_Load(cfg);
+    EPD_HAL_Set(&epd_hal_linux);
+}
+
+void epd_hal_linux_busy_cmd(uint8_t cmd, uint32_t ms)
+{
+    m_busy_cmd_ms[cmd] = ms;
+}
+
+void epd_hal_linux_busy_param(uint8_t cmd, uint8_t param_cmd, uint8_t mask, uint32_t ms)
+{
+    m_busy_param.cmd = cmd;
+    m_busy_param.param_cmd = param_cmd;
+    m_busy_param.mask = mask;
+    m_busy_param.ms = ms;
+}
+
+void epd_hal_linux_busy_value(uint8_t cmd, uint8_t param_cmd, uint8_t value, uint32_t ms)
+{
+    m_busy_value_rule.cmd = cmd;
+    m_busy_value_rule.param_cmd = param_cmd;
+    m_busy_value_rule.value = value;
+    m_busy_value_rule.ms = ms;
+}
+
+void epd_hal_linux_read_value(uint8_t value)
+{
+    m_read_value = value;
+}
+
+void epd_hal_linux_trace(FILE *fp)
+{
+    trace_flush();
+    m_trace = fp;
+}
+
+epd_hal_linux_stats_t *epd_hal_linux_stats(void)
+{
+    trace_flush();
+    return &m_stats;
+}
+
+void epd_hal_linux_stats_reset(void)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
@@ -0,0 +1,47 @@
+#ifndef __EPD_HAL_LINUX_H
+#define __EPD_HAL_LINUX_H
+
+#include <stdio.h>
+#include "EPD_hal.h"
+#include "EPD_config.h"
+
+/**@brief SPI traffic recorded by the Linux backend. */
+typedef struct
+{
+    uint32_t commands;                                /**< Bytes sent with DC low */
+    uint32_t data_bytes;                              /**< Bytes sent with DC high */
+    uint32_t read_bytes;                              /**< Bytes read back from the panel */
+    uint32_t transactions;                            /**< Number of spi_write/spi_fill/spi_read calls */
+    uint32_t busy_waits;                              /**< Number of BUSY waits */
+    uint32_t busy_ms;                                 /**< Simulated time spent waiting on BUSY */
+    uint32_t delay_ms;                                /**< Time spent in delay() */
+} epd_hal_linux_stats_t;
+
+/**@brief Set pin mapping and the BUSY level of the simulated panel. */
+void epd_hal_linux_init(epd_config_t *cfg, uint32_t busy_value);
+
+/**@brief Let command cmd hold BUSY for ms milliseconds. */
+void epd_hal_linux_busy_cmd(uint8_t cmd, uint32_t ms);
+
+/**@brief Let command cmd hold BUSY for ms milliseconds instead when the last
+ *         data byte written to param_cmd has a bit of mask set, e.g. the
+ *         display mode 2 bit of an update sequence.
+ */
+void epd_hal_linux_busy_param(uint8_t cmd, uint8_t param_cmd, uint8_t mask, uint32_t ms);
+
+/**@brief Let command cmd hold BUSY for ms milliseconds when the last data
+ *         byte written to param_cmd equals value, checked before the
+ *         epd_hal_linux_busy_param rule, e.g. a power off sequence.
+ */
+void epd_hal_linux_busy_value(uint8_t cmd, uint8_t param_cmd, uint8_t value, uint32_t ms);
+
+/**@brief Set the byte returned by SPI reads. */
+void epd_hal_linux_read_value(uint8_t value);
+
+/**@brief Dump the command/data stream to fp, NULL to disable. */
+void epd_hal_linux_trace(FILE *fp);
+
+epd_hal_linux_stats_t *epd_hal_linux_stats(void);
+void epd_hal_linux_stats_reset(void);
+
+#endif
@@ -0,0 +1,412 @@
+/* nRF5x backend of the EPD hardware abstraction layer */
+
+#include <string.h>
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_scheduler.h"
+#include "app_util_platform.h"
+#include "nrf_delay.h"
+#include "nrf_gpio.h"
+#include "nrf_drv_spi.h"
+#include "nrf_drv_gpiote.h"
+#include "nrf_pwr_mgmt.h"
+#include "EPD_driver.h"
+#include "nrf_log.h"
+
+#define SPI_INSTANCE  0 /**< SPI instance index. */
+#define SPI_MAX_XFER  255 /**< Maximum length of a single nrf_drv_spi transfer. */
+#define SPI_FILL_SIZE 64 /**< Size of the stack buffer used by hal_spi_fill. */
+static const nrf_drv_spi_t spi = NRF_DRV_SPI_INSTANCE(SPI_INSTANCE);  /**< SPI instance. */
+
+static uint32_t m_spi_sclk_pin;
+static uint32_t m_spi_mosi_pin;
+
+#if defined(S112)
+#define TIMER_TICKS(MS) APP_TIMER_TICKS(MS)
+#define TIMER_FREQ (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
+#define HAL_SPI_INSTANCE spi.u.spi.p_reg
+#else
+#define TIMER_TICKS(MS) APP_TIMER_TICKS(MS, 0)
+#define TIMER_FREQ APP_TIMER_CLOCK_FREQ // prescaler 0, see main.c
+#define HAL_SPI_INSTANCE spi.p_registers
+nrf_gpio_pin_dir_t nrf_gpio_pin_dir_get(uint32_t pin)
+{
+    NRF_GPIO_Type * reg = nrf_gpio_pin_port_decode(&pin);
+    return (nrf_gpio_pin_dir_t)((reg->PIN_CNF[pin] &
+                                 GPIO_PIN_CNF_DIR_Msk) >> GPIO_PIN_CNF_DIR_Pos);
+}
+#endif
+
+// GPIO
+static void hal_pin_mode(uint32_t pin, uint32_t mode)
+{
+    switch (mode)
+    {
+        case INPUT:
+            nrf_gpio_cfg_input(pin, NRF_GPIO_PIN_NOPULL);
+            break;
+        case INPUT_PULLUP:
+            nrf_gpio_cfg_input(pin, NRF_GPIO_PIN_PULLUP);
+            break;
+        case INPUT_PULLDOWN:
+            nrf_gpio_cfg_input(pin, NRF_GPIO_PIN_PULLDOWN);
+            break;
+        case OUTPUT:
+            nrf_gpio_cfg_output(pin);
+            break;
+        case DEFAULT:
+        default:
+            nrf_gpio_cfg_default(pin);
+            break;
+    }
+}
+
+static void hal_pin_write(uint32_t pin, uint32_t value)
+{
+    nrf_gpio_pin_write(pin, value);
+}
+
+static uint32_t hal_pin_read(uint32_t pin)
+{
+    return nrf_gpio_pin_read(pin);
+}
+
+static uint32_t hal_pin_out_read(uint32_t pin)
+{
+    return nrf_gpio_pin_out_read(pin);
+}
+
+// Timer
+static void hal_delay(uint32_t ms)
+{
+    nrf_delay_ms(ms);
+}
+
+// The RTC counter is 24 bit and wraps every 1024 s (512 s on nRF51), a
+// repeated timer extends it even if millis() is not called for longer.
+#define MILLIS_POLL_INTERVAL 60000
+
+APP_TIMER_DEF(m_millis_timer_id);
+
+static uint32_t hal_millis(void);
+
+static void millis_timer_handler(void * p_context)
+{
+    hal_millis();
+}
+
+static uint32_t hal_millis(void)
+{
+    static bool timer_created = false;
+    static uint32_t last_ticks = 0;
+    static uint64_t total_ticks = 0;
+    uint64_t total;
+
+    if (!timer_created) {
+        timer_created = true;
+        APP_ERROR_CHECK(app_timer_create(&m_millis_timer_id, APP_TIMER_MODE_REPEATED, millis_timer_handler));
+        APP_ERROR_CHECK(app_timer_start(m_millis_timer_id, TIMER_TICKS(MILLIS_POLL_INTERVAL), NULL));
+    }
+
+    CRITICAL_REGION_ENTER(); // also called from the poll timer
+    uint32_t ticks = app_timer_cnt_get();
+#if defined(S112)
+    total_ticks += app_timer_cnt_diff_compute(ticks, last_ticks);
+#else
+    uint32_t diff = 0;
+    app_timer_cnt_diff_compute(ticks, last_ticks, &diff);
+    total_ticks += diff;
+#endif
+    last_ticks = ticks;
+    total = total_ticks;
+    CRITICAL_REGION_EXIT();
+
+    return (uint32_t)(total * 1000 / TIMER_FREQ);
+}
+
+// SPI
+// transfers are blocking: the GUI page buffer takes most of the heap, so there
+// is no second band to render while one is on the bus, and on nRF51 (no
+// EasyDMA) the event handler mode would take one interrupt per byte
+static void spi_xfer(uint8_t *tx, uint8_t tx_len, uint8_t *rx, uint8_t rx_len)
+{
+    APP_ERROR_CHECK(nrf_drv_spi_transfer(&spi, tx, tx_len, rx, rx_len));
+}
+
+static void hal_spi_init(uint32_t sclk_pin, uint32_t mosi_pin, uint32_t cs_pin)
+{
+    nrf_drv_spi_config_t spi_config = NRF_DRV_SPI_DEFAULT_CONFIG;
+    spi_config.sck_pin = sclk_pin;
+    spi_config.mosi_pin = mosi_pin;
+    spi_config.ss_pin = cs_pin;
+    m_spi_sclk_pin = sclk_pin;
+    m_spi_mosi_pin = mosi_pin;
+#if defined(S112)
+    APP_ERROR_CHECK(nrf_drv_spi_init(&spi, &spi_config, NULL, NULL));
+#else
+    APP_ERROR_CHECK(nrf_drv_spi_init(&spi, &spi_config, NULL));
+#endif
+}
+
+static void hal_spi_uninit(void)
+{
+    nrf_drv_spi_uninit(&spi);
+}
+
+static void spi_mosi_output(void)
+{
+    nrf_gpio_pin_dir_t dir = nrf_gpio_pin_dir_get(m_spi_mosi_pin);
+    if (dir != NRF_GPIO_PIN_DIR_OUTPUT) {
+        nrf_gpio_cfg_output(m_spi_mosi_pin);
+        nrf_spi_pins_set(HAL_SPI_INSTANCE, m_spi_sclk_pin, m_spi_mosi_pin, NRF_SPI_PIN_NOT_CONNECTED);
+    }
+}
+
+static void hal_spi_write(uint8_t *data, uint16_t len)
+{
+    spi_mosi_output();
+    while (len > 0) {
+        uint8_t n = len > SPI_MAX_XFER ? SPI_MAX_XFER : len;
+        spi_xfer(data, n, NULL, 0);
+        data += n;
+        len -= n;
+    }
+}
+
+// write the same byte len times, batched into SPI_FILL_SIZE bytes per transfer
+static void hal_spi_fill(uint8_t value, uint16_t len)
+{
+    uint8_t buf[SPI_FILL_SIZE];
+    memset(buf, value, sizeof(buf));
+
+    spi_mosi_output();
+    while (len > 0) {
+        uint8_t n = len > sizeof(buf) ? sizeof(buf) : len;
+        spi_xfer(buf, n, NULL, 0);
+        len -= n;
+    }
+}
+
+static void hal_spi_read(uint8_t *data, uint16_t len)
+{
+    nrf_gpio_pin_dir_t dir = nrf_gpio_pin_dir_get(m_spi_mosi_pin);
+    if (dir != NRF_GPIO_PIN_DIR_INPUT) {
+        nrf_gpio_cfg_input(m_spi_mosi_pin, NRF_GPIO_PIN_NOPULL);
+        nrf_spi_pins_set(HAL_SPI_INSTANCE, m_spi_sclk_pin, NRF_SPI_PIN_NOT_CONNECTED, m_spi_mosi_pin);
+    }
+    while (len > 0) {
+        uint8_t n = len > SPI_MAX_XFER ? SPI_MAX_XFER : len;
+        spi_xfer(NULL, 0, data, n);
+        data += n;
+        len -= n;
+    }
+}
+
+// GPIOTE, shared with the wakeup pin in main.c
+static uint8_t m_gpiote_refs = 0;
+
+void epd_hal_gpiote_acquire(void)
+{
+    CRITICAL_REGION_ENTER();
+    if (m_gpiote_refs++ == 0 && !nrf_drv_gpiote_is_init())
+        APP_ERROR_CHECK(nrf_drv_gpiote_init());
+    CRITICAL_REGION_EXIT();
+}
+
+void epd_hal_gpiote_release(void)
+{
+    CRITICAL_REGION_ENTER();
+    if (m_gpiote_refs > 0 && --m_gpiote_refs == 0 && nrf_drv_gpiote_is_init())
+        nrf_drv_gpiote_uninit();
+    CRITICAL_REGION_EXIT();
+}
+
+// BUSY
+APP_TIMER_DEF(m_busy_timer_id);
+static volatile bool m_busy_timeout = false;
+static bool m_busy_irq_enabled = false;
+static uint32_t m_busy_pin;
+
+// async busy wait state
+static volatile bool m_busy_async = false;
+static uint32_t m_busy_value;
+static epd_hal_busy_handler_t m_busy_handler = NULL;
+
+static void busy_irq_disable(void);
+
+static void busy_async_sched_handler(void * p_event_data, uint16_t event_size)
+{
+    busy_irq_disable();
+
+    epd_hal_busy_handler_t handler = m_busy_handler;
+    m_busy_handler = NULL;
+    if (handler) handler(m_busy_timeout);
+}
+
+static void busy_async_done(void)
+{
+    if (!m_busy_async) return;
+    m_busy_async = false;
+    APP_ERROR_CHECK(app_sched_event_put(NULL, 0, busy_async_sched_handler));
+}
+
+static void busy_timeout_handler(void * p_context)
+{
+    m_busy_timeout = true;
+    busy_async_done();
+}
+
+static void busy_pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+    // synchronous waits are woken up by the interrupt itself
+    if (m_busy_async && nrf_gpio_pin_read(m_busy_pin) != m_busy_value)
+        busy_async_done();
+}
+
+static void busy_irq_enable(uint32_t pin, uint16_t timeout)
+{
+    static bool timer_created = false;
+    if (!timer_created) {
+        APP_ERROR_CHECK(app_timer_create(&m_busy_timer_id, APP_TIMER_MODE_SINGLE_SHOT, busy_timeout_handler));
+        timer_created = true;
+    }
+
+    m_busy_pin = pin;
+    epd_hal_gpiote_acquire();
+    nrf_drv_gpiote_in_config_t config = GPIOTE_CONFIG_IN_SENSE_TOGGLE(false);
+    APP_ERROR_CHECK(nrf_drv_gpiote_in_init(pin, &config, busy_pin_handler));
+    nrf_drv_gpiote_in_event_enable(pin, true);
+    m_busy_irq_enabled = true;
+
+    // app_timer rejects timeouts below APP_TIMER_MIN_TIMEOUT_TICKS, an
+    // uploaded init sequence may ask for 0
+    uint32_t ticks = TIMER_TICKS(timeout);
+    if (ticks < APP_TIMER_MIN_TIMEOUT_TICKS) ticks = APP_TIMER_MIN_TIMEOUT_TICKS;
+    m_busy_timeout = false;
+    APP_ERROR_CHECK(app_timer_start(m_busy_timer_id, ticks, NULL));
+}
+
+static void busy_irq_disable(void)
+{
+    app_timer_stop(m_busy_timer_id);
+
+    if (m_busy_irq_enabled) {
+        nrf_drv_gpiote_in_event_disable(m_busy_pin);
+        nrf_drv_gpiote_in_uninit(m_busy_pin);
+        epd_hal_gpiote_release();
+        m_busy_irq_enabled = false;
+    }
+
+    nrf_gpio_cfg_input(m_busy_pin, NRF_GPIO_PIN_NOPULL); // gpiote resets the pin on uninit
+}
+
+static bool hal_busy_wait(uint32_t pin, uint32_t value, uint16_t timeout)
+{
+    if (nrf_gpio_pin_read(pin) != value) return true;
+
+    if (current_int_priority_get() == APP_IRQ_PRIORITY_THREAD) {
+        // sleep until BUSY edge or timeout
+        busy_irq_enable(pin, timeout);
+        while (nrf_gpio_pin_read(pin) == value && !m_busy_timeout)
+            nrf_pwr_mgmt_run();
+        busy_irq_disable();
+        return !m_busy_timeout;
+    }
+
+    // interrupt context, the wakeup sources can't preempt us
+    while (nrf_gpio_pin_read(pin) == value) {
+        if (timeout == 0) return false;
+        nrf_delay_ms(1);
+        timeout--;
+    }
+    return true;
+}
+
+static void hal_busy_wait_async(uint32_t pin, uint32_t value, uint16_t timeout, epd_hal_busy_handler_t handler)
+{
+    m_busy_value = value;
+    m_busy_handler = handler;
+
+    busy_irq_enable(pin, timeout);
+    m_busy_async = true;
+    // BUSY may have been released before the edge detection was armed
+    if (nrf_gpio_pin_read(pin) != value) {
+        CRITICAL_REGION_ENTER();
+        busy_async_done();
+        CRITICAL_REGION_EXIT();
+    }
+}
+
+// VDD voltage
+#define VDD_SAMPLES 8 /**< Samples averaged per VDD measurement. */
+
+static uint16_t hal_read_voltage(void)
+{
+#if defined(S112)
+    volatile int16_t value = 0;
+    NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_10bit;
+    NRF_SAADC->OVERSAMPLE = SAADC_OVERSAMPLE_OVERSAMPLE_Over8x; // VDD_SAMPLES in one burst
+    NRF_SAADC->ENABLE = (SAADC_ENABLE_ENABLE_Enabled << SAADC_ENABLE_ENABLE_Pos);
+    NRF_SAADC->CH[0].CONFIG = ((SAADC_CH_CONFIG_RESP_Bypass     << SAADC_CH_CONFIG_RESP_Pos)   & SAADC_CH_CONFIG_RESP_Msk)
+                            | ((SAADC_CH_CONFIG_RESP_Bypass     << SAADC_CH_CONFIG_RESN_Pos)   & SAADC_CH_CONFIG_RESN_Msk)
+                            | ((SAADC_CH_CONFIG_GAIN_Gain1_6    << SAADC_CH_CONFIG_GAIN_Pos)   & SAADC_CH_CONFIG_GAIN_Msk)
+                            | ((SAADC_CH_CONFIG_REFSEL_Internal << SAADC_CH_CONFIG_REFSEL_Pos) & SAADC_CH_CONFIG_REFSEL_Msk)
+                            | ((SAADC_CH_CONFIG_TACQ_3us        << SAADC_CH_CONFIG_TACQ_Pos)   & SAADC_CH_CONFIG_TACQ_Msk)
+                            | ((SAADC_CH_CONFIG_MODE_SE         << SAADC_CH_CONFIG_MODE_Pos)   & SAADC_CH_CONFIG_MODE_Msk)
+                            | ((SAADC_CH_CONFIG_BURST_Enabled   << SAADC_CH_CONFIG_BURST_Pos)  & SAADC_CH_CONFIG_BURST_Msk);
+    NRF_SAADC->CH[0].PSELN = SAADC_CH_PSELN_PSELN_NC;
+    NRF_SAADC->CH[0].PSELP = SAADC_CH_PSELP_PSELP_VDD;
+    NRF_SAADC->RESULT.PTR = (uint32_t)&value;
+    NRF_SAADC->RESULT.MAXCNT = 1;
+    NRF_SAADC->TASKS_START = 0x01UL;
+    while (!NRF_SAADC->EVENTS_STARTED);
+    NRF_SAADC->EVENTS_STARTED = 0x00UL;
+    NRF_SAADC->TASKS_SAMPLE = 0x01UL;
+    while (!NRF_SAADC->EVENTS_END);
+    NRF_SAADC->EVENTS_END = 0x00UL;
+    NRF_SAADC->TASKS_STOP = 0x01UL;
+    while (!NRF_SAADC->EVENTS_STOPPED);
+    NRF_SAADC->EVENTS_STOPPED = 0x00UL;
+    if (value < 0) value = 0;
+    NRF_SAADC->CH[0].PSELP = SAADC_CH_PSELP_PSELP_NC;
+    NRF_SAADC->OVERSAMPLE = SAADC_OVERSAMPLE_OVERSAMPLE_Bypass;
+    NRF_SAADC->ENABLE = (SAADC_ENABLE_ENABLE_Disabled << SAADC_ENABLE_ENABLE_Pos);
+#else
+    uint32_t value = 0;
+    NRF_ADC->ENABLE = 1;
+    NRF_ADC->CONFIG = (ADC_CONFIG_RES_10bit << ADC_CONFIG_RES_Pos) |
+                      (ADC_CONFIG_INPSEL_SupplyOneThirdPrescaling << ADC_CONFIG_INPSEL_Pos) |
+                      (ADC_CONFIG_REFSEL_VBG << ADC_CONFIG_REFSEL_Pos) |
+                      (ADC_CONFIG_PSEL_Disabled << ADC_CONFIG_PSEL_Pos) |
+                      (ADC_CONFIG_EXTREFSEL_None << ADC_CONFIG_EXTREFSEL_Pos);
+    for (uint8_t i = 0; i < VDD_SAMPLES; i++) {
+        NRF_ADC->TASKS_START = 1;
+        while(!NRF_ADC->EVENTS_END);
+        NRF_ADC->EVENTS_END = 0;
+        value += NRF_ADC->RESULT;
+    }
+    NRF_ADC->TASKS_STOP = 1;
+    NRF_ADC->ENABLE = 0;
+    value = (value + VDD_SAMPLES / 2) / VDD_SAMPLES;
+#endif
+    NRF_LOG_DEBUG("ADC value: %d\n", value);
+    // both ADCs have a 3.6V full scale here (0.6V ref / (1/6), 1.2V ref / (1/3))
+    return (uint16_t)((value * 3600UL) >> 10);
+}
+
+const epd_hal_t epd_hal_nrf = {
+    .pin_mode = hal_pin_mode,
+    .pin_write = hal_pin_write,
+    .pin_read = hal_pin_read,
+    .pin_out_read = hal_pin_out_read,
+    .spi_init = hal_spi_init,
+    .spi_uninit = hal_spi_uninit,
+    .spi_write = hal_spi_write,
+    .spi_fill = hal_spi_fill,
+    .spi_read = hal_spi_read,
+    .delay_ms = hal_delay,
+    .millis = hal_millis,
+    .busy_wait = hal_busy_wait,
+    .busy_wait_async = hal_busy_wait_async,
+    .read_voltage = hal_read_voltage,
+};
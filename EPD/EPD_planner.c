@@ -0,0 +1,54 @@
+/* Refresh planner
+ *
+ * Fast waveforms leave some ghosting behind every time they drive a pixel,
+ * more so on a cold panel. The planner counts the non-full refreshes of each
+ * band of the screen since the last full refresh and asks for a full one
+ * when the worst band is over the budget for the current temperature.
+ */
+
+#include <string.h>
+#include "EPD_planner.h"
+#include "nrf_log.h"
+
+static uint8_t m_partial_count[EPD_PLANNER_BANDS];
+static uint32_t m_last_full = 0;                    // millis() of the last full refresh
+
+// non-full refreshes a band can take before it needs a full one
+static uint8_t epd_planner_budget(int8_t temperature)
+{
+    if (temperature < 5) return 5;
+    if (temperature < 15) return 15;
+    return 40;
+}
+
+void epd_planner_refreshed(epd_refresh_mode_t mode, uint16_t y, uint16_t h)
+{
+    if (mode == EPD_REFRESH_FULL || mode == EPD_REFRESH_GRAY) {
+        memset(m_partial_count, 0, sizeof(m_partial_count));
+        m_last_full = millis();
+        return;
+    }
+
+    uint16_t height = epd_get()->height;
+    uint16_t band = (height + EPD_PLANNER_BANDS - 1) / EPD_PLANNER_BANDS;
+    if (h == 0 || y >= height) return;
+    if (y + h > height) h = height - y;
+    for (uint8_t i = y / band; i <= (y + h - 1) / band; i++) {
+        if (m_partial_count[i] < UINT8_MAX) m_partial_count[i]++;
+    }
+}
+
+epd_refresh_mode_t epd_planner_select(epd_refresh_mode_t mode, int8_t temperature)
+{
+    if (mode == EPD_REFRESH_FULL || mode == EPD_REFRESH_GRAY) return mode;
+
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < EPD_PLANNER_BANDS; i++) {
+        if (m_partial_count[i] > count) count = m_partial_count[i];
+    }
+    if (count >= epd_planner_budget(temperature) || millis() - m_last_full >= EPD_PLANNER_MAX_AGE) {
+        NRF_LOG_DEBUG("[EPD]: full refresh planned, partial count %d, temperature %d\n", count, temperature);
+        return EPD_REFRESH_FULL;
+    }
+    return mode;
+}
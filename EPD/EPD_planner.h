@@ -0,0 +1,21 @@
+#ifndef __EPD_PLANNER_H
+#define __EPD_PLANNER_H
+
+#include "EPD_driver.h"
+
+#define EPD_PLANNER_BANDS       8                       /**< Horizontal bands partial refreshes are counted in */
+#define EPD_PLANNER_MAX_AGE     (4UL * 3600 * 1000)     /**< Longest time (ms) without a full refresh */
+
+/**@brief Record a refresh, the area is in panel coordinates.
+ *
+ * @details A full (OTP) refresh clears the counters, other modes add one
+ *          to every band they cover.
+ */
+void epd_planner_refreshed(epd_refresh_mode_t mode, uint16_t y, uint16_t h);
+
+/**@brief Refresh mode for an update, EPD_REFRESH_FULL if ghosting is likely
+ *         built up for the panel temperature or the last full refresh is too old.
+ */
+epd_refresh_mode_t epd_planner_select(epd_refresh_mode_t mode, int8_t temperature);
+
+#endif
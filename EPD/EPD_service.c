@@ -17,7 +17,9 @@
 #include "nrf_gpio.h"
 #include "nrf_pwr_mgmt.h"
 #include "app_scheduler.h"
+#include "app_timer.h"
 #include "EPD_service.h"
+#include "EPD_planner.h"
 #include "main.h"
 #include "nrf_log.h"
 
@@ -32,55 +34,302 @@
 #define EPD_CFG_DEFAULT {0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x03, 0x09, 0x03}
 #endif
 
-static void epd_gui_update(void * p_event_data, uint16_t event_size)
+#if defined(S112)
+#define TIMER_TICKS(MS) APP_TIMER_TICKS(MS)
+#else
+#define TIMER_TICKS(MS) APP_TIMER_TICKS(MS, 0)
+#endif
+
+APP_TIMER_DEF(m_session_timer_id);
+static bool m_session_active = false;
+static GFX_DirtyMap m_gui_dirty;                        /**< Tiles of the last GUI frame in the panel RAM */
+static epd_init_seq_t m_init_seq;                       /**< Uploaded init sequence, also the flash write buffer */
+
+static void epd_rx_schedule(ble_epd_t * p_epd);
+
+/**@brief Hold GPIO/SPI for a session, the idle timer is stopped until the
+ *        next epd_session_close.
+ */
+static void epd_session_hold(void)
+{
+    app_timer_stop(m_session_timer_id);
+    if (!m_session_active) EPD_GPIO_Init();
+    m_session_active = true;
+}
+
+/**@brief Open a driver session, the panel is only reset and initialized if
+ *        there is no session alive from a previous update.
+ */
+static epd_model_t *epd_session_open(ble_epd_t * p_epd)
+{
+    epd_model_t *prev = p_epd->epd;
+    bool alive = m_session_active && prev != NULL && prev->id == p_epd->config.model_id;
+
+    epd_session_hold();
+    if (alive) return p_epd->epd;
+
+    p_epd->epd = epd_init((epd_model_id_t)p_epd->config.model_id);
+    // the last GUI frame is still in the panel RAM if the controller kept it
+    // over the deep sleep and the panel power wasn't switched off
+    if (p_epd->epd != prev || !p_epd->epd->drv->sleep_keeps_ram || p_epd->config.en_pin != 0xFF)
+        GFX_invalidate(&m_gui_dirty);
+    return p_epd->epd;
+}
+
+/**@brief End the session now: put the panel into deep sleep and release SPI. */
+static void epd_session_end(ble_epd_t * p_epd)
+{
+    app_timer_stop(m_session_timer_id);
+    if (!m_session_active) return;
+
+    NRF_LOG_DEBUG("[EPD]: session end\n");
+#if defined(S112)
+    conn_profile_bulk_exit(); // no refresh came after the image
+#endif
+    epd_get()->drv->sleep();
+    EPD_GPIO_Uninit();
+    m_session_active = false;
+}
+
+/**@brief (Re)start the EPD_SESSION_IDLE_TIMEOUT countdown of the session. */
+static void epd_session_close(ble_epd_t * p_epd)
+{
+    if (!m_session_active) return;
+    app_timer_stop(m_session_timer_id);
+    APP_ERROR_CHECK(app_timer_start(m_session_timer_id, TIMER_TICKS(EPD_SESSION_IDLE_TIMEOUT * 1000), p_epd));
+}
+
+static void epd_session_idle_handler(void * p_event_data, uint16_t event_size)
+{
+    ble_epd_t *p_epd = *(ble_epd_t **)p_event_data;
+
+    if (epd_refresh_busy())
+        epd_session_close(p_epd); // try again later
+    else
+        epd_session_end(p_epd);
+}
+
+static void epd_session_timeout_handler(void * p_context)
+{
+    app_sched_event_put(&p_context, sizeof(p_context), epd_session_idle_handler);
+}
+
+/**@brief Notify the refresh time and resume the packets held back during the refresh. */
+static void epd_refresh_notify(ble_epd_t * p_epd, uint32_t elapsed)
+{
+    uint8_t buf[] = {EPD_CMD_REFRESH, elapsed >> 24, elapsed >> 16, elapsed >> 8, elapsed};
+    uint32_t err_code = ble_epd_string_send(p_epd, buf, sizeof(buf));
+    if (err_code != NRF_SUCCESS) // best effort, the peer may be gone
+        NRF_LOG_DEBUG("[EPD]: refresh notify failed: %d\n", err_code);
+    epd_rx_schedule(p_epd);
+}
+
+static uint32_t m_gui_update_start;
+
+static void epd_gui_update_done(void * p_context, uint32_t elapsed)
+{
+    EPD_Stats()->gui_update_ms += millis() - m_gui_update_start;
+    epd_session_close((ble_epd_t *)p_context);
+    app_feed_wdt();
+    epd_refresh_notify((ble_epd_t *)p_context, elapsed);
+}
+
+static void epd_gui_part_update_done(void * p_context, uint32_t elapsed)
+{
+    EPD_Stats()->gui_part_update_ms += millis() - m_gui_update_start;
+    epd_session_close((ble_epd_t *)p_context);
+    app_feed_wdt();
+    epd_refresh_notify((ble_epd_t *)p_context, elapsed);
+}
+
+void epd_gui_update(void * p_event_data, uint16_t event_size)
 {
     epd_gui_update_event_t *event = (epd_gui_update_event_t *)p_event_data;
     ble_epd_t *p_epd = event->p_epd;
 
-    EPD_GPIO_Init();
-    epd_model_t *epd = epd_init((epd_model_id_t)p_epd->config.model_id);
+    if (epd_refresh_busy()) return;
+
+    m_gui_update_start = millis();
+    epd_model_t *epd = epd_session_open(p_epd);
     gui_data_t data = {
         .bwr             = epd->bwr,
         .width           = epd->width,
         .height          = epd->height,
         .timestamp       = event->timestamp,
-        .temperature     = epd->drv->read_temp(),
+        .temperature     = EPD_ReadTemp(),
         .voltage         = EPD_ReadVoltage(),
+        .dirty           = &m_gui_dirty,
     };
+    epd_refresh_mode_t mode = epd_planner_select((epd_refresh_mode_t)event->refresh_mode, data.temperature);
     DrawGUI(&data, epd->drv->write_image, p_epd->display_mode);
-    epd->drv->refresh();
-    EPD_GPIO_Uninit();
+    epd_planner_refreshed(mode, 0, epd->height);
+    epd_refresh_async(mode, epd_gui_update_done, p_epd);
+}
 
-    app_feed_wdt();
+// count the partial window for the planner
+static void epd_gui_write_partial(uint8_t *black, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    epd_get()->drv->write_partial_image(black, x, y, w, h);
+    epd_planner_refreshed(EPD_REFRESH_PARTIAL, y, h);
 }
 
-static void epd_gui_part_update(void * p_event_data, uint16_t event_size)
+void epd_gui_part_update(void * p_event_data, uint16_t event_size)
 {
     epd_gui_update_event_t *event = (epd_gui_update_event_t *)p_event_data;
     ble_epd_t *p_epd = event->p_epd;
 
-    EPD_GPIO_Init();
+    if (epd_refresh_busy()) return;
 
-    epd_model_t *epd = epd_init((epd_model_id_t)p_epd->config.model_id);
-    epd->bwr = false; 
+    m_gui_update_start = millis();
+    epd_model_t *epd = epd_session_open(p_epd);
+    if (epd_planner_select(EPD_REFRESH_PARTIAL, EPD_ReadTemp()) == EPD_REFRESH_FULL) {
+        epd_gui_update_event_t full = *event;
+        full.refresh_mode = EPD_REFRESH_FULL;
+        epd_gui_update(&full, sizeof(full));
+        return;
+    }
     gui_data_t data = {
-        .bwr             = epd->bwr,
+        .bwr             = false,
         .width           = epd->width,
         .height          = epd->height,
         .timestamp       = event->timestamp,
-        .temperature     = epd->drv->read_temp(),
+        .temperature     = EPD_ReadTemp(),
         .voltage         = EPD_ReadVoltage(),
+        .dirty           = &m_gui_dirty,
     };
-    EPD_Reset(HIGH, 1); 
-    DrawGUITime(&data, epd->drv->write_partial_image);
-    epd->drv->read_temp();
-    EPD_WriteCommand(0x22); // Display Update Control 2
-    EPD_WriteByte(0xF4);    // 0xF4 = 执行一次只更新黑/白通道的全屏刷新
-    EPD_WriteCommand(0x20); // Master Activation
-    EPD_WaitBusy(HIGH, 5000); // 等待刷新完成
-    epd->drv->sleep();
-    EPD_GPIO_Uninit();
-    app_feed_wdt();
+    DrawGUITime(&data, epd_gui_write_partial);
+    epd_refresh_async(EPD_REFRESH_PARTIAL, epd_gui_part_update_done, p_epd);
+}
+
+static void epd_cmd_refresh_done(void * p_context, uint32_t elapsed)
+{
+#if defined(S112)
+    conn_profile_bulk_exit();
+#endif
+    epd_refresh_notify((ble_epd_t *)p_context, elapsed);
+}
+
+// send epd_stats_t as [cmd, offset, data...] chunks to fit the ATT MTU
+static void epd_stats_send(ble_epd_t * p_epd)
+{
+    uint8_t *stats = (uint8_t *)EPD_Stats();
+    uint8_t buf[BLE_EPD_MAX_DATA_LEN];
+    uint8_t chunk = p_epd->max_data_len - 2;
+
+    for (uint8_t offset = 0; offset < sizeof(epd_stats_t); offset += chunk) {
+        uint8_t len = sizeof(epd_stats_t) - offset;
+        if (len > chunk) len = chunk;
+        buf[0] = EPD_CMD_GET_STATS;
+        buf[1] = offset;
+        memcpy(&buf[2], stats + offset, len);
+        uint32_t err_code = ble_epd_string_send(p_epd, buf, len + 2);
+        if (err_code != NRF_SUCCESS) {
+            NRF_LOG_DEBUG("[EPD]: stats send failed: %d\n", err_code);
+            break;
+        }
+    }
+}
+
+// credit based flow control: the host starts with EPD_RX_CREDITS packets and
+// gets one credit back for every packet handled, in batches of half the window.
+// Only used in main context, credits are returned once the packets are drained
+// from the receive buffer.
+static bool m_credit_enabled = false;
+static uint8_t m_credit_pending;                        // handled packets not returned yet
+
+static void epd_credit_send(ble_epd_t * p_epd)
+{
+    uint8_t buf[] = {EPD_CMD_FLOW_CTRL, m_credit_pending};
+    if (!m_credit_enabled || m_credit_pending == 0) return;
+    if (ble_epd_string_send(p_epd, buf, sizeof(buf)) == NRF_SUCCESS)
+        m_credit_pending = 0; // otherwise retried after a notification was sent
+}
+
+static void epd_credit_return(ble_epd_t * p_epd)
+{
+    if (!m_credit_enabled) return;
+    m_credit_pending++;
+    if (m_credit_pending >= EPD_RX_CREDITS / 2) epd_credit_send(p_epd);
+}
+
+// image data state, PackBits runs and literals may span packets
+static struct {
+    uint8_t literal;    // literal bytes left
+    uint8_t repeat;     // run length waiting for its value byte
+    bool window;        // RAM writes go to a write_window area
+} m_image;
+
+static void epd_image_begin(ble_epd_t * p_epd, uint8_t flag)
+{
+    bool black = (flag & 0x0F) != 0x00;
+
+    m_image.literal = 0;
+    m_image.repeat = 0;
+    if (m_image.window && p_epd->epd->drv->write_window_end) { // a full image after a region write
+        p_epd->epd->drv->write_window_end();
+        m_image.window = false;
+    }
+    if (p_epd->epd->drv->write_ram)
+        p_epd->epd->drv->write_ram(!black);
+    else
+        EPD_WriteCommand(black ? p_epd->epd->drv->cmd_write_ram1 : p_epd->epd->drv->cmd_write_ram2);
+}
+
+// decode straight into the panel RAM, runs are sent with EPD_FillData
+static void epd_image_write_rle(uint8_t *data, uint16_t len)
+{
+    while (len > 0) {
+        if (m_image.literal > 0) {
+            uint8_t n = MIN(m_image.literal, len);
+            EPD_WriteData(data, n);
+            m_image.literal -= n;
+            data += n;
+            len -= n;
+        } else if (m_image.repeat > 0) {
+            EPD_FillData(*data, m_image.repeat);
+            m_image.repeat = 0;
+            data++;
+            len--;
+        } else {
+            int8_t header = (int8_t)*data++;
+            len--;
+            if (header >= 0)
+                m_image.literal = header + 1;
+            else if (header != -128)
+                m_image.repeat = 1 - header;
+        }
+    }
+}
+
+// notify 31 + first band + CRC16 (big endian) of each band, 31 only if the
+// panel RAM can't be read back
+static void epd_ram_checksum_send(ble_epd_t * p_epd, bool red, uint8_t rows)
+{
+    uint8_t buf[BLE_EPD_MAX_DATA_LEN];
+    uint16_t height = p_epd->epd->height;
+    uint16_t bands = rows > 0 ? (height + rows - 1) / rows : 0;
+    uint8_t per_packet = (p_epd->max_data_len - 2) / 2;
+
+    buf[0] = EPD_CMD_RAM_CHECKSUM;
+    if (p_epd->epd->drv->ram_checksum == NULL || bands == 0 || bands > UINT8_MAX) {
+        ble_epd_string_send(p_epd, buf, 1);
+        return;
+    }
+    for (uint16_t band = 0; band < bands; band += per_packet) {
+        uint8_t len = 2;
+        buf[1] = band;
+        for (uint16_t i = band; i < bands && i < band + per_packet; i++) {
+            uint16_t y = i * rows;
+            uint16_t crc = p_epd->epd->drv->ram_checksum(red, y, MIN(rows, height - y));
+            buf[len++] = crc >> 8;
+            buf[len++] = crc & 0xFF;
+        }
+        uint32_t err_code = ble_epd_string_send(p_epd, buf, len);
+        if (err_code != NRF_SUCCESS) {
+            NRF_LOG_DEBUG("[EPD]: checksum send failed: %d\n", err_code);
+            break;
+        }
+    }
 }
 
 /**@brief Function for handling the @ref BLE_GAP_EVT_CONNECTED event from the S110 SoftDevice.
@@ -92,6 +341,14 @@ static void on_connect(ble_epd_t * p_epd, ble_evt_t * p_ble_evt)
 {
     p_epd->conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
     EPD_GPIO_Init();
+    EPD_LED_ON();
+}
+
+// runs after the packets received before the disconnect are handled
+static void epd_disconnect_handler(void * p_event_data, uint16_t event_size)
+{
+    m_credit_enabled = false;
+    EPD_GPIO_Uninit();
 }
 
 /**@brief Function for handling the @ref BLE_GAP_EVT_DISCONNECTED event from the S110 SoftDevice.
@@ -103,7 +360,7 @@ static void on_disconnect(ble_epd_t * p_epd, ble_evt_t * p_ble_evt)
 {
     UNUSED_PARAMETER(p_ble_evt);
     p_epd->conn_handle = BLE_CONN_HANDLE_INVALID;
-    EPD_GPIO_Uninit();
+    APP_ERROR_CHECK(app_sched_event_put(NULL, 0, epd_disconnect_handler));
 }
 
 static void epd_service_on_write(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
@@ -112,11 +369,17 @@ static void epd_service_on_write(ble_epd_t * p_epd, uint8_t * p_data, uint16_t l
     NRF_LOG_HEXDUMP_DEBUG(p_data, length);
     if (p_data == NULL || length <= 0) return;
 
+    // panel RAM is changed by the host, send the whole next GUI frame
+    bool ram_write = p_data[0] <= EPD_CMD_SEND_DATA || p_data[0] == EPD_CMD_FILL || p_data[0] == EPD_CMD_WRITE_IMAGE ||
+                     p_data[0] == EPD_CMD_WRITE_IMAGE_RLE || p_data[0] == EPD_CMD_WRITE_REGION;
+    if (ram_write) GFX_invalidate(&m_gui_dirty);
+
     switch (p_data[0])
     {
       case EPD_CMD_SET_PINS:
           if (length < 8) return;
 
+          epd_session_end(p_epd);
           p_epd->config.mosi_pin = p_data[1];
           p_epd->config.sclk_pin = p_data[2];
           p_epd->config.cs_pin = p_data[3];
@@ -131,6 +394,7 @@ static void epd_service_on_write(ble_epd_t * p_epd, uint8_t * p_data, uint16_t l
           EPD_GPIO_Uninit();
           EPD_GPIO_Load(&p_epd->config);
           EPD_GPIO_Init();
+          EPD_LED_ON();
           break;
 
       case EPD_CMD_INIT: {
@@ -139,12 +403,17 @@ static void epd_service_on_write(ble_epd_t * p_epd, uint8_t * p_data, uint16_t l
               p_epd->config.model_id = id;
               epd_config_write(&p_epd->config);
           }
+          epd_session_hold(); // kept alive by the following host commands
           p_epd->epd = epd_init((epd_model_id_t)id);
         } break;
 
       case EPD_CMD_CLEAR:
           p_epd->display_mode = MODE_NONE;
-          p_epd->epd->drv->clear(length > 1 ? p_data[1] : true);
+          p_epd->epd->drv->clear(false);
+          if (length < 2 || p_data[1]) {
+              epd_planner_refreshed(EPD_REFRESH_FULL, 0, p_epd->epd->height);
+              epd_refresh_async(EPD_REFRESH_FULL, epd_cmd_refresh_done, p_epd);
+          }
           break;
 
       case EPD_CMD_SEND_COMMAND:
@@ -156,13 +425,25 @@ static void epd_service_on_write(ble_epd_t * p_epd, uint8_t * p_data, uint16_t l
           EPD_WriteData(&p_data[1], length - 1);
           break;
 
-      case EPD_CMD_REFRESH:
+      case EPD_CMD_REFRESH: {
+          epd_refresh_mode_t mode = length > 1 ? (epd_refresh_mode_t)p_data[1] : EPD_REFRESH_FULL;
           p_epd->display_mode = MODE_NONE;
-          p_epd->epd->drv->refresh();
-          break;
+          epd_planner_refreshed(mode, 0, p_epd->epd->height);
+          epd_refresh_async(mode, epd_cmd_refresh_done, p_epd);
+        } break;
 
       case EPD_CMD_SLEEP:
-          p_epd->epd->drv->sleep();
+          if (m_session_active)
+              epd_session_end(p_epd);
+          else
+              p_epd->epd->drv->sleep();
+          break;
+
+      case EPD_CMD_FILL: // x, y, w, h (big endian), color
+          if (length < 10 || p_epd->epd->drv->fill_rect == NULL) return;
+          p_epd->epd->drv->fill_rect((p_data[1] << 8) | p_data[2], (p_data[3] << 8) | p_data[4],
+                                     (p_data[5] << 8) | p_data[6], (p_data[7] << 8) | p_data[8],
+                                     (epd_color_t)p_data[9]);
           break;
 
       case EPD_CMD_SET_TIME: {
@@ -179,12 +460,36 @@ static void epd_service_on_write(ble_epd_t * p_epd, uint8_t * p_data, uint16_t l
       } break;
 
       case EPD_CMD_WRITE_IMAGE: // MSB=0000: ram begin, LSB=1111: black
+      case EPD_CMD_WRITE_IMAGE_RLE:
           if (length < 3) return;
           if ((p_data[1] >> 4) == 0x00) {
-              bool black = (p_data[1] & 0x0F) == 0x0F;
-              EPD_WriteCommand(black ? p_epd->epd->drv->cmd_write_ram1 : p_epd->epd->drv->cmd_write_ram2);
+#if defined(S112)
+              conn_profile_bulk_enter(); // left after the refresh
+#endif
+              epd_image_begin(p_epd, p_data[1]);
           }
-          EPD_WriteData(&p_data[2], length - 2);
+          if (p_data[0] == EPD_CMD_WRITE_IMAGE_RLE)
+              epd_image_write_rle(&p_data[2], length - 2);
+          else
+              EPD_WriteData(&p_data[2], length - 2);
+          break;
+
+      case EPD_CMD_WRITE_REGION: // plane (0: black, 1: red), x, y, w, h (big endian), data follows as 30/32 with MSB=1111
+          if (length < 10 || p_epd->epd->drv->write_window == NULL) return;
+          m_image.literal = 0;
+          m_image.repeat = 0;
+          m_image.window = true;
+#if defined(S112)
+          conn_profile_bulk_enter();
+#endif
+          p_epd->epd->drv->write_window((p_data[2] << 8) | p_data[3], (p_data[4] << 8) | p_data[5],
+                                        (p_data[6] << 8) | p_data[7], (p_data[8] << 8) | p_data[9],
+                                        p_data[1] == 0x01);
+          break;
+
+      case EPD_CMD_RAM_CHECKSUM: // plane (0: black, 1: red), rows per band
+          if (length < 3) return;
+          epd_ram_checksum_send(p_epd, p_data[1] == 0x01, p_data[2]);
           break;
 
       case EPD_CMD_SET_CONFIG:
@@ -193,6 +498,41 @@ static void epd_service_on_write(ble_epd_t * p_epd, uint8_t * p_data, uint16_t l
           epd_config_write(&p_epd->config);
           break;
 
+      case EPD_CMD_GET_STATS:
+          epd_stats_send(p_epd);
+          if (length > 1 && p_data[1]) EPD_StatsReset();
+          break;
+
+      case EPD_CMD_SET_INIT_SEQ: // 01: offset + data, 02: save for current model, 03: erase
+          if (length < 2) return;
+          if (p_data[1] == 0x01 && length > 3) {
+              uint8_t offset = p_data[2];
+              uint16_t len = length - 3;
+              if (offset + len > EPD_INIT_SEQ_MAX) return;
+              EPD_SetInitSequence((epd_model_id_t)p_epd->config.model_id, NULL); // 上传过程中不使用
+              memcpy(&m_init_seq.data[offset], &p_data[3], len);
+              m_init_seq.length = offset == 0 ? len : MAX(m_init_seq.length, offset + len);
+          } else if (p_data[1] == 0x02) {
+              if (m_init_seq.length > EPD_INIT_SEQ_MAX || !EPD_SequenceValid(m_init_seq.data, m_init_seq.length)) {
+                  NRF_LOG_DEBUG("[EPD]: invalid init sequence\n");
+                  return;
+              }
+              m_init_seq.model_id = p_epd->config.model_id;
+              epd_init_seq_write(&m_init_seq);
+              EPD_SetInitSequence((epd_model_id_t)m_init_seq.model_id, m_init_seq.data);
+          } else if (p_data[1] == 0x03) {
+              EPD_SetInitSequence((epd_model_id_t)p_epd->config.model_id, NULL);
+              memset(&m_init_seq, 0xFF, sizeof(m_init_seq));
+              epd_init_seq_clear();
+          }
+          break;
+
+      case EPD_CMD_FLOW_CTRL: // the enabling packet is counted like all packets after it
+          m_credit_enabled = true;
+          m_credit_pending = EPD_RX_CREDITS;
+          epd_credit_send(p_epd);
+          break;
+
       case EPD_CMD_SYS_SLEEP:
           sleep_mode_enter();
           break;
@@ -216,6 +556,91 @@ static void epd_service_on_write(ble_epd_t * p_epd, uint8_t * p_data, uint16_t l
     }
 }
 
+// receive ring buffer, packets are stored as [length, data...]. The BLE event
+// handler (interrupt context) only copies packets in, the panel is driven by
+// the scheduler in main context.
+STATIC_ASSERT((EPD_RX_BUF_SIZE & (EPD_RX_BUF_SIZE - 1)) == 0);
+STATIC_ASSERT(EPD_RX_CREDITS * (BLE_EPD_MAX_DATA_LEN + 1) <= EPD_RX_BUF_SIZE);
+
+#define EPD_RX_NEARLY_FULL (EPD_RX_BUF_SIZE - 2 * (BLE_EPD_MAX_DATA_LEN + 1))
+
+static uint8_t m_rx_buf[EPD_RX_BUF_SIZE];
+static volatile uint16_t m_rx_head = 0;                 // written by the BLE event handler
+static volatile uint16_t m_rx_tail = 0;                 // written by the consumer
+static volatile bool m_rx_scheduled = false;            // consumer event is in the scheduler queue
+static bool m_rx_full_notified = false;
+
+static uint16_t epd_rx_used(void)
+{
+    return (m_rx_head - m_rx_tail) & (EPD_RX_BUF_SIZE - 1);
+}
+
+static void epd_rx_copy_out(uint16_t pos, uint8_t *data, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++)
+        data[i] = m_rx_buf[(pos + i) & (EPD_RX_BUF_SIZE - 1)];
+}
+
+static void epd_rx_handler(void * p_event_data, uint16_t event_size)
+{
+    ble_epd_t *p_epd = *(ble_epd_t **)p_event_data;
+    static uint8_t packet[BLE_EPD_MAX_DATA_LEN];
+
+    m_rx_scheduled = false; // packets added after this schedule a new event
+    while (epd_rx_used() > 0) {
+        uint16_t tail = m_rx_tail;
+        uint8_t len = m_rx_buf[tail];
+        // the panel ignores the bus while BUSY, panel commands wait in the
+        // buffer until the refresh is done (see epd_refresh_notify)
+        if (len > 0 && m_rx_buf[(tail + 1) & (EPD_RX_BUF_SIZE - 1)] <= EPD_CMD_WRITE_REGION && epd_refresh_busy()) {
+            NRF_LOG_DEBUG("[EPD]: busy, %d bytes held back\n", epd_rx_used());
+            break;
+        }
+        epd_rx_copy_out(tail + 1, packet, len);
+        m_rx_tail = (tail + 1 + len) & (EPD_RX_BUF_SIZE - 1);
+        epd_service_on_write(p_epd, packet, len);
+        // host panel commands keep the session alive, SET_PINS and SLEEP end it
+        if (len > 0 && (packet[0] <= EPD_CMD_WRITE_REGION) && packet[0] != EPD_CMD_SET_TIME)
+            epd_session_close(p_epd);
+        epd_credit_return(p_epd);
+    }
+    if (epd_rx_used() == 0) m_rx_full_notified = false;
+    epd_credit_send(p_epd);
+}
+
+static void epd_rx_schedule(ble_epd_t * p_epd)
+{
+    if (m_rx_scheduled) return;
+    m_rx_scheduled = true;
+    if (app_sched_event_put(&p_epd, sizeof(p_epd), epd_rx_handler) != NRF_SUCCESS)
+        m_rx_scheduled = false; // retried on the next packet
+}
+
+static void epd_rx_put(ble_epd_t * p_epd, uint8_t * p_data, uint16_t length)
+{
+    uint16_t used = epd_rx_used();
+    uint16_t head = m_rx_head;
+
+    if (length > BLE_EPD_MAX_DATA_LEN || used + length + 1 >= EPD_RX_BUF_SIZE) {
+        NRF_LOG_DEBUG("[EPD]: rx buffer full, %d bytes dropped\n", length);
+        return;
+    }
+    m_rx_buf[head] = length;
+    for (uint16_t i = 0; i < length; i++)
+        m_rx_buf[(head + 1 + i) & (EPD_RX_BUF_SIZE - 1)] = p_data[i];
+    m_rx_head = (head + 1 + length) & (EPD_RX_BUF_SIZE - 1);
+
+    used += length + 1;
+    epd_stats_t *stats = EPD_Stats();
+    if (used > stats->rx_buf_max) stats->rx_buf_max = used;
+    // hosts without credits are asked to slow down, once until the buffer is drained
+    if (used >= EPD_RX_NEARLY_FULL && !m_rx_full_notified) {
+        uint8_t buf[] = {EPD_CMD_FLOW_CTRL, 0x00};
+        m_rx_full_notified = ble_epd_string_send(p_epd, buf, sizeof(buf)) == NRF_SUCCESS;
+    }
+    epd_rx_schedule(p_epd);
+}
+
 /**@brief Function for handling the @ref BLE_GATTS_EVT_WRITE event from the S110 SoftDevice.
  *
  * @param[in] p_epd     EPD Service structure.
@@ -248,7 +673,7 @@ static void on_write(ble_epd_t * p_epd, ble_evt_t * p_ble_evt)
     }
     else if (p_evt_write->handle == p_epd->char_handles.value_handle)
     {
-        epd_service_on_write(p_epd, p_evt_write->data, p_evt_write->len);
+        epd_rx_put(p_epd, p_evt_write->data, p_evt_write->len);
     }
     else
     {
@@ -287,6 +712,14 @@ void ble_epd_on_ble_evt(ble_epd_t * p_epd, ble_evt_t * p_ble_evt)
             on_write(p_epd, p_ble_evt);
             break;
 
+#if defined(S112)
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+#else
+        case BLE_EVT_TX_COMPLETE:
+#endif
+            if (m_credit_pending > 0) epd_rx_schedule(p_epd); // retry the credit notification
+            break;
+
         default:
             // No implementation needed.
             break;
@@ -338,6 +771,7 @@ static uint32_t epd_service_init(ble_epd_t * p_epd)
 
 void ble_epd_sleep_prepare(ble_epd_t * p_epd)
 {
+    epd_session_end(p_epd);
     // Turn off led
     EPD_LED_OFF();
     // Prepare wakeup pin
@@ -370,6 +804,13 @@ uint32_t ble_epd_init(ble_epd_t * p_epd)
     // load config
     EPD_GPIO_Load(&p_epd->config);
 
+    // 上位机写入的屏幕初始化序列
+    epd_init_seq_read(&m_init_seq);
+    if (m_init_seq.length <= EPD_INIT_SEQ_MAX && EPD_SequenceValid(m_init_seq.data, m_init_seq.length))
+        EPD_SetInitSequence((epd_model_id_t)m_init_seq.model_id, m_init_seq.data);
+
+    APP_ERROR_CHECK(app_timer_create(&m_session_timer_id, APP_TIMER_MODE_SINGLE_SHOT, epd_session_timeout_handler));
+
     // blink LED on start
     EPD_LED_BLINK();
 
@@ -404,8 +845,8 @@ void ble_epd_on_timer(ble_epd_t * p_epd, uint32_t timestamp, bool force_update)
     // 条件2：日历模式下，每天 00:00:00 更新 (timestamp 是自午夜以来的秒数)
     bool is_calendar_update = (p_epd->display_mode == MODE_CALENDAR && timestamp % 86400 == 0);
 
-    // 条件3：时钟模式下，每 10 分钟更新一次 (例如 xx:00, xx:10, xx:20)
-    bool is_clock_full_update = (p_epd->display_mode == MODE_CLOCK && timestamp % 600 == 0);
+    // 条件3：时钟模式下，整点重绘整个界面 (小时和日期可能变化)
+    bool is_clock_full_update = (p_epd->display_mode == MODE_CLOCK && timestamp % 3600 == 0);
 
     // 条件4：时钟模式下，每分钟更新一次 (用于局部刷新)
     bool is_clock_part_update = (p_epd->display_mode == MODE_CLOCK && timestamp % 60 == 0);
@@ -413,13 +854,15 @@ void ble_epd_on_timer(ble_epd_t * p_epd, uint32_t timestamp, bool force_update)
     // 如果满足强制更新或主要的刷新条件，则执行全屏更新
     if (is_forced || is_calendar_update || is_clock_full_update) 
     {
-        epd_gui_update_event_t event = { p_epd, timestamp };
+        // 时钟模式整点使用快刷波形，残影较多时由刷新规划改为 OTP 全刷
+        bool fast = !is_forced && !is_calendar_update;
+        epd_gui_update_event_t event = { p_epd, timestamp, fast ? EPD_REFRESH_FAST : EPD_REFRESH_FULL };
         app_sched_event_put(&event, sizeof(epd_gui_update_event_t), epd_gui_update);
     }
-    // 否则，如果满足时钟的分钟更新条件，则执行局部更新
+    // 否则，如果满足时钟的分钟更新条件，则执行局部更新（同样由刷新规划决定是否改为全刷）
     else if (is_clock_part_update)
     {
-        epd_gui_update_event_t event = { p_epd, timestamp }; 
+        epd_gui_update_event_t event = { p_epd, timestamp, EPD_REFRESH_PARTIAL };
         app_sched_event_put(&event, sizeof(epd_gui_update_event_t), epd_gui_part_update);
     }
 }
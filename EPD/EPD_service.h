@@ -43,7 +43,15 @@ void ble_epd_evt_handler(ble_evt_t const * p_ble_evt, void * p_context);
 #define BLE_EPD_DEF(_name) static ble_epd_t _name;
 #endif
 
-#define APP_VERSION 0x16
+#define APP_VERSION 0x20
+#define EPD_RX_CREDITS 8                                /**< Packets the host may have in flight with flow control */
+#if defined(S112)
+#define EPD_RX_BUF_SIZE 2048                            /**< Receive ring buffer size, power of 2 */
+#else
+#define EPD_RX_BUF_SIZE 512                             /**< Receive ring buffer size, power of 2 */
+#endif
+
+#define EPD_SESSION_IDLE_TIMEOUT 90                     /**< Seconds the panel stays initialized after an update or host command, longer than the clock tick */
 
 #define BLE_UUID_EPD_SVC_BASE              {{0XEC, 0X5A, 0X67, 0X1C, 0XC1, 0XB6, 0X46, 0XFB, \
                                              0X8D, 0X91, 0X28, 0XD8, 0X22, 0X36, 0X75, 0X62}}
@@ -67,16 +75,23 @@ enum EPD_CMDS
     EPD_CMD_CLEAR        = 0x02,                        /**< clear EPD screen */
     EPD_CMD_SEND_COMMAND = 0x03,                        /**< send command to EPD */
     EPD_CMD_SEND_DATA    = 0x04,                        /**< send data to EPD */
-    EPD_CMD_REFRESH      = 0x05,                        /**< diaplay EPD ram on screen */
+    EPD_CMD_REFRESH      = 0x05,                        /**< diaplay EPD ram on screen, notifies elapsed ms when done */
     EPD_CMD_SLEEP        = 0x06,                        /**< EPD enter sleep mode */
+    EPD_CMD_FILL         = 0x07,                        /**< fill an area of EPD ram with one color */
 
 	EPD_CMD_SET_TIME     = 0x20,                        /** < set time with unix timestamp */
 
     EPD_CMD_WRITE_IMAGE  = 0x30,                        /** < write image data to EPD ram */
+    EPD_CMD_RAM_CHECKSUM = 0x31,                        /**< notify CRC16 of EPD ram bands */
+    EPD_CMD_WRITE_IMAGE_RLE = 0x32,                     /**< write PackBits compressed image data to EPD ram */
+    EPD_CMD_WRITE_REGION = 0x33,                        /**< select EPD ram window for the following image data */
 
     EPD_CMD_SET_CONFIG   = 0x90,                        /**< set full EPD config */
     EPD_CMD_SYS_RESET    = 0x91,                        /**< MCU reset */
     EPD_CMD_SYS_SLEEP    = 0x92,                        /**< MCU enter sleep mode */
+    EPD_CMD_GET_STATS    = 0x93,                        /**< notify performance counters, reset them if param is 1 */
+    EPD_CMD_SET_INIT_SEQ = 0x94,                        /**< upload/save/erase the panel init sequence */
+    EPD_CMD_FLOW_CTRL    = 0x95,                        /**< enable credit based flow control, credits are notified as 95 + count, 95 00 when the receive buffer is nearly full */
     EPD_CMD_CFG_ERASE    = 0x99,                        /**< Erase config and reset */
 };
 
@@ -101,6 +116,7 @@ typedef struct
 {
     ble_epd_t *p_epd;
     uint32_t timestamp;
+    uint8_t refresh_mode;                             /**< @ref epd_refresh_mode_t of a full GUI update */
 } epd_gui_update_event_t;
 
 #define EPD_GUI_SCHD_EVENT_DATA_SIZE sizeof(epd_gui_update_event_t)
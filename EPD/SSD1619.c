@@ -19,15 +19,58 @@
 #define CMD_DISP_CTRL2            0x22        // Display Update Control 2
 #define CMD_WRITE_RAM1            0x24        // Write RAM (BW)
 #define CMD_WRITE_RAM2            0x26        // Write RAM (RED)
+#define CMD_READ_RAM              0x27        // Read RAM
 #define CMD_VCOM_CTRL             0x2B        // Write Register for VCOM Control
+#define CMD_WRITE_LUT             0x32        // Write LUT register
 #define CMD_BORDER_CTRL           0x3C        // Border Waveform Control
+#define CMD_READ_RAM_OPT          0x41        // Read RAM Option
 #define CMD_RAM_XPOS              0x44        // Set RAM X - address Start / End position
 #define CMD_RAM_YPOS              0x45        // Set Ram Y- address Start / End position
+#define CMD_AUTO_WRITE_RED        0x46        // Auto Write RED RAM for Regular Pattern
+#define CMD_AUTO_WRITE_BW         0x47        // Auto Write B/W RAM for Regular Pattern
 #define CMD_RAM_XCOUNT            0x4E        // Set RAM X address counter
 #define CMD_RAM_YCOUNT            0x4F        // Set RAM Y address counter
 #define CMD_ANALOG_BLOCK_CTRL     0x74        // Set Analog Block Control
 #define CMD_DIGITAL_BLOCK_CTRL    0x7E        // Set Digital Block Control
 
+// fast black/white waveform, RED RAM is bypassed so only LUT0 (black) and
+// LUT1 (white) are used. Each VS byte holds phase A-D, 00 VSS, 01 VSH1, 10 VSL.
+// Pixels are driven to the opposite color first, then to the target color.
+#define LUT_SIZE                  70          // VS of LUT0-4 (5 x 7 bytes), TP/RP of 7 groups (7 x 5 bytes)
+
+static const uint8_t lut_fast_bw[LUT_SIZE] = {
+    0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // LUT0: black
+    0x60, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // LUT1: white
+    0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // LUT2: unused
+    0x60, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // LUT3: unused
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // LUT4: VCOM
+    0x0A, 0x0A, 0x00, 0x00, 0x01,             // group 0: TP A, B, C, D, repeat
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+// 4 level grayscale waveform, the gray level is the (RAM1, RAM2) bit pair.
+// Group 0 shakes every pixel black then white, group 1 drives it back
+// towards black for a time depending on the level.
+static const uint8_t lut_gray[LUT_SIZE] = {
+    0x60, 0x54, 0x00, 0x00, 0x00, 0x00, 0x00, // LUT0: 00 black
+    0x60, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, // LUT1: 10 light gray
+    0x60, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, // LUT2: 01 dark gray
+    0x60, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // LUT3: 11 white
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // LUT4: VCOM
+    0x0A, 0x0A, 0x00, 0x00, 0x01,             // group 0: TP A, B, C, D, repeat
+    0x14, 0x0A, 0x05, 0x00, 0x01,             // group 1
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
 static void SSD1619_WaitBusy(uint16_t timeout)
 {
     EPD_WaitBusy(HIGH, timeout);
@@ -54,6 +97,15 @@ void SSD1619_Force_Temp(int8_t value)
     EPD_WriteByte(value);
 }
 
+static void _setRamPointer(uint16_t x, uint16_t y)
+{
+    EPD_WriteCommand(CMD_RAM_XCOUNT);
+    EPD_WriteByte(x / 8);
+    EPD_WriteCommand(CMD_RAM_YCOUNT);
+    EPD_WriteByte(y % 256);
+    EPD_WriteByte(y / 256);
+}
+
 static void _setPartialRamArea(uint16_t x, uint16_t y, uint16_t w, uint16_t h)
 {
     EPD_WriteCommand(CMD_DATA_MODE); // set ram entry mode
@@ -66,77 +118,240 @@ static void _setPartialRamArea(uint16_t x, uint16_t y, uint16_t w, uint16_t h)
     EPD_WriteByte(y / 256);
     EPD_WriteByte((y + h - 1) % 256);
     EPD_WriteByte((y + h - 1) / 256);
-    EPD_WriteCommand(CMD_RAM_XCOUNT);
-    EPD_WriteByte(x / 8);
-    EPD_WriteCommand(CMD_RAM_YCOUNT);
-    EPD_WriteByte(y % 256);
-    EPD_WriteByte(y / 256);
+    _setRamPointer(x, y);
 }
 
-void SSD1619_Init()
+// read n bytes of a RAM starting at x, y, the address wraps at the RAM window
+static void _readRam(bool red, uint16_t x, uint16_t y, uint8_t *data, uint16_t n)
 {
-    epd_model_t *EPD = epd_get();
+    _setRamPointer(x, y);
+    EPD_WriteCommand(CMD_READ_RAM_OPT);
+    EPD_WriteByte(red ? 0x01 : 0x00);
+    EPD_WriteCommand(CMD_READ_RAM);
+    EPD_ReadByte(); // dummy
+    EPD_ReadData(data, n);
+}
 
-    EPD_Reset(HIGH, 10);
+// init sequence of a w x h panel, the RAM window covers the whole screen
+#define SSD1619_INIT_SEQ(w, h)                                                      \
+    EPD_SEQ_RESET, 10,                                                              \
+    EPD_SEQ_CMD(0), CMD_SW_RESET,                                                   \
+    EPD_SEQ_BUSY, 20,                                                               \
+    EPD_SEQ_CMD(1), CMD_ANALOG_BLOCK_CTRL, 0x54,                                    \
+    EPD_SEQ_CMD(1), CMD_DIGITAL_BLOCK_CTRL, 0x3B,                                   \
+    EPD_SEQ_CMD(3), CMD_DRIVER_CTRL, ((h) - 1) % 256, ((h) - 1) / 256, 0x00,        \
+    EPD_SEQ_CMD(1), CMD_BORDER_CTRL, 0x01,                                          \
+    EPD_SEQ_CMD(1), CMD_TSENSOR_CTRL, 0x80,                                         \
+    EPD_SEQ_CMD(1), CMD_DATA_MODE, 0x03,                                            \
+    EPD_SEQ_CMD(2), CMD_RAM_XPOS, 0x00, ((w) - 1) / 8,                              \
+    EPD_SEQ_CMD(4), CMD_RAM_YPOS, 0x00, 0x00, ((h) - 1) % 256, ((h) - 1) / 256,     \
+    EPD_SEQ_CMD(1), CMD_RAM_XCOUNT, 0x00,                                           \
+    EPD_SEQ_CMD(2), CMD_RAM_YCOUNT, 0x00, 0x00,                                     \
+    EPD_SEQ_END
+
+static const uint8_t init_seq_420[] = { SSD1619_INIT_SEQ(400, 300) };
+static const uint8_t init_seq_213[] = { SSD1619_INIT_SEQ(136, 250) };
 
-    EPD_WriteCommand(CMD_SW_RESET);
+void SSD1619_Init()
+{
+    EPD_RunSequence(EPD_InitSequence());
+}
+
+// display mode 1 with a waveform from the LUT register, the voltages still
+// come from OTP
+static void SSD1619_Update_LUT(const uint8_t *lut, uint8_t ram_option)
+{
+    SSD1619_Update(0x91); // load LUT
     SSD1619_WaitBusy(200);
+    EPD_WriteCommand(CMD_WRITE_LUT);
+    EPD_WriteData((uint8_t *)lut, LUT_SIZE);
+    EPD_WriteCommand(CMD_DISP_CTRL1);
+    EPD_WriteByte(ram_option);
+    EPD_WriteByte(0x00); // Single chip application
+    SSD1619_Update(0xC7); // display mode 1 without loading LUT from OTP
+}
 
-    EPD_WriteCommand(CMD_ANALOG_BLOCK_CTRL);
-    EPD_WriteByte(0x54);
-    EPD_WriteCommand(CMD_DIGITAL_BLOCK_CTRL);
-    EPD_WriteByte(0x3B);
+static void SSD1619_Refresh_Start(epd_refresh_mode_t mode)
+{
+    NRF_LOG_DEBUG("[EPD]: refresh begin, mode %d\n", mode);
+
+    // the OTP waveform is selected by the cached temperature, the update
+    // sequences below don't run the sensor again (0x20 is not set)
+    SSD1619_Force_Temp(EPD_ReadTemp());
+
+    // every branch sets the RAM options, the panel is not reset between
+    // updates and would keep the ones of the last refresh
+    if (mode == EPD_REFRESH_PARTIAL) {
+        EPD_WriteCommand(CMD_DISP_CTRL1);
+        EPD_WriteByte(0x00); // Normal RED RAM, holds the shown frame
+        EPD_WriteByte(0x00); // Single chip application
+        SSD1619_Update(0xDC); // display with the mode 2 (fast) waveform, 0x08 selects mode 2
+        return;
+    }
 
-    EPD_WriteCommand(CMD_DRIVER_CTRL);
-    EPD_WriteByte((EPD->height - 1) % 256);
-    EPD_WriteByte((EPD->height - 1) / 256);
-    EPD_WriteByte(0x00);
+    if (mode == EPD_REFRESH_DIFF && !epd_get()->bwr) {
+        // RAM1 holds the new frame, RAM2 the shown one (see SSD1619_Sync_Ram2)
+        EPD_WriteCommand(CMD_DISP_CTRL1);
+        EPD_WriteByte(0x00); // Normal RED RAM
+        EPD_WriteByte(0x00); // Single chip application
+        SSD1619_Update(0xDC); // display with the mode 2 waveform
+        return;
+    }
 
-    EPD_WriteCommand(CMD_BORDER_CTRL);
-    EPD_WriteByte(0x01);
-    EPD_WriteCommand(CMD_TSENSOR_CTRL);
-    EPD_WriteByte(0x80);
+    if (mode == EPD_REFRESH_FAST && !epd_get()->bwr) {
+        SSD1619_Update_LUT(lut_fast_bw, 0x40); // Bypass RED RAM as 0
+        return;
+    }
 
-    _setPartialRamArea(0, 0, EPD->width, EPD->height);
+    if (mode == EPD_REFRESH_GRAY && !epd_get()->bwr) {
+        SSD1619_Update_LUT(lut_gray, 0x00); // Normal RED RAM
+        return;
+    }
+
+    EPD_WriteCommand(CMD_DISP_CTRL1);
+    EPD_WriteByte(0x80); // Inverse RED RAM
+    EPD_WriteByte(0x00); // Single chip application
+    SSD1619_Update(0xD7);
 }
 
-static void SSD1619_Refresh(void)
+// B/W panels keep the shown frame in RAM2, the mode 2 waveform (partial and
+// diff refresh) only drives the pixels that differ from RAM1. RAM2 is brought
+// up to date after every refresh from the windows written to RAM1 since the
+// last one, a fill is written again with the same pattern, other windows are
+// read back from RAM1.
+#define SYNC_WINDOWS 4
+#define SYNC_COPY    0xFF // copy the window from RAM1, else the fill value
+
+typedef struct {
+    uint16_t x, y, w, h; // byte aligned
+    uint8_t fill;
+} sync_window_t;
+
+static sync_window_t m_sync[SYNC_WINDOWS];
+static uint8_t m_sync_count = 0;
+
+static void _addSyncWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t fill)
+{
+    uint8_t n = 0;
+
+    if (epd_get()->bwr) return;
+    // windows covered by the new one are replaced by it
+    for (uint8_t i = 0; i < m_sync_count; i++) {
+        sync_window_t *win = &m_sync[i];
+        if (win->x >= x && win->y >= y && win->x + win->w <= x + w && win->y + win->h <= y + h)
+            continue;
+        m_sync[n++] = *win;
+    }
+    m_sync_count = n;
+    if (m_sync_count == SYNC_WINDOWS) { // merge the older windows into their bounding box
+        sync_window_t *box = &m_sync[0];
+        for (uint8_t i = 1; i < m_sync_count; i++) {
+            sync_window_t *win = &m_sync[i];
+            uint16_t x2 = box->x + box->w > win->x + win->w ? box->x + box->w : win->x + win->w;
+            uint16_t y2 = box->y + box->h > win->y + win->h ? box->y + box->h : win->y + win->h;
+            if (win->x < box->x) box->x = win->x;
+            if (win->y < box->y) box->y = win->y;
+            box->w = x2 - box->x;
+            box->h = y2 - box->y;
+        }
+        box->fill = SYNC_COPY;
+        m_sync_count = 1;
+    }
+    m_sync[m_sync_count++] = (sync_window_t){ x, y, w, h, fill };
+}
+
+// RAM1 and RAM2 were both written, a fill replayed over the area would undo it
+static void _overwriteSyncWindows(uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    for (uint8_t i = 0; i < m_sync_count; i++) {
+        sync_window_t *win = &m_sync[i];
+        if (win->x < x + w && x < win->x + win->w && win->y < y + h && y < win->y + win->h)
+            win->fill = SYNC_COPY;
+    }
+}
+
+// fill the RAM window with one value, the controller writes the pattern itself
+static void SSD1619_Auto_Write(uint8_t cmd, bool value)
+{
+    EPD_WriteCommand(cmd);
+    EPD_WriteByte(value ? 0xF7 : 0x77); // first pixel value, steps larger than the window
+    SSD1619_WaitBusy(200);
+}
+
+// replay the windows written since the last refresh to RAM2, in order
+static void SSD1619_Sync_Ram2(void)
 {
     epd_model_t *EPD = epd_get();
+    uint8_t buf[64];
+
+    for (uint8_t i = 0; i < m_sync_count; i++) {
+        sync_window_t *win = &m_sync[i];
+        uint16_t wb = (win->w + 7) / 8;
+        uint32_t size = (uint32_t)wb * win->h;
+
+        if (win->x + win->w > EPD->width || win->y + win->h > EPD->height) continue; // model changed
+        _setPartialRamArea(win->x, win->y, win->w, win->h); // addresses wrap inside the window
+        if (win->fill != SYNC_COPY) {
+            SSD1619_Auto_Write(CMD_AUTO_WRITE_RED, win->fill);
+            continue;
+        }
+        for (uint32_t offset = 0; offset < size; offset += sizeof(buf)) {
+            uint16_t n = size - offset > sizeof(buf) ? sizeof(buf) : size - offset;
+            uint16_t x = win->x + (offset % wb) * 8;
+            uint16_t y = win->y + offset / wb;
+            _readRam(false, x, y, buf, n);
+            _setRamPointer(x, y);
+            EPD_WriteCommand(CMD_WRITE_RAM2);
+            EPD_WriteData(buf, n);
+        }
+    }
+    if (m_sync_count > 0) _setPartialRamArea(0, 0, EPD->width, EPD->height);
+    m_sync_count = 0;
+}
 
-    EPD_WriteCommand(CMD_DISP_CTRL1);
-    EPD_WriteByte(0x80); // Inverse RED RAM
-    EPD_WriteByte(0x00); // Single chip application
+static void SSD1619_Refresh_End(void)
+{
+    epd_model_t *EPD = epd_get();
 
-    NRF_LOG_DEBUG("[EPD]: refresh begin\n");
-    NRF_LOG_DEBUG("[EPD]: temperature: %d\n", SSD1619_Read_Temp());
-    SSD1619_Update(0xF7);
-    SSD1619_WaitBusy(30000);
     NRF_LOG_DEBUG("[EPD]: refresh end\n");
-
     _setPartialRamArea(0, 0, EPD->width, EPD->height); // DO NOT REMOVE!
     SSD1619_Update(0x83); // power off
+    SSD1619_WaitBusy(200);
+    if (!EPD->bwr) SSD1619_Sync_Ram2();
 }
 
-void SSD1619_Clear(bool refresh)
+static void SSD1619_Refresh(void)
+{
+    SSD1619_Refresh_Start(EPD_REFRESH_FULL);
+    SSD1619_WaitBusy(30000);
+    SSD1619_Refresh_End();
+}
+
+void SSD1619_Fill_Rect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, epd_color_t color)
 {
     epd_model_t *EPD = epd_get();
-    uint16_t Width = (EPD->width + 7) / 8;
-    uint16_t Height = EPD->height;
+    bool red = EPD->bwr && color == EPD_COLOR_RED;
+    bool white = color == EPD_COLOR_WHITE || red;
+    w += x % 8; // byte boundary
+    x -= x % 8;
+    if (x >= EPD->width || y >= EPD->height || w == 0 || h == 0) return;
+    if (x + w > EPD->width) w = EPD->width - x;
+    if (y + h > EPD->height) h = EPD->height - y;
 
+    _setPartialRamArea(x, y, w, h);
+    SSD1619_Auto_Write(CMD_AUTO_WRITE_BW, white);
+    if (EPD->bwr)
+        SSD1619_Auto_Write(CMD_AUTO_WRITE_RED, !red);
+    else // RAM2 holds the shown frame until the refresh
+        _addSyncWindow(x, y, w, h, white);
     _setPartialRamArea(0, 0, EPD->width, EPD->height);
-    EPD_WriteCommand(CMD_WRITE_RAM1);
-    for (uint16_t j = 0; j < Height; j++) {
-        for (uint16_t i = 0; i < Width; i++) {
-            EPD_WriteByte(0xFF);
-        }
-    }
-    EPD_WriteCommand(CMD_WRITE_RAM2);
-    for (uint16_t j = 0; j < Height; j++) {
-        for (uint16_t i = 0; i < Width; i++) {
-            EPD_WriteByte(0xFF);
-        }
-    }
+}
+
+void SSD1619_Clear(bool refresh)
+{
+    epd_model_t *EPD = epd_get();
+
+    SSD1619_Fill_Rect(0, 0, EPD->width, EPD->height, EPD_COLOR_WHITE);
 
     if (refresh) SSD1619_Refresh();
 }
@@ -151,20 +366,19 @@ void SSD1619_Write_Image(uint8_t *black, uint8_t *color, uint16_t x, uint16_t y,
 
     _setPartialRamArea(x, y, w, h);
     EPD_WriteCommand(CMD_WRITE_RAM1);
-    for (uint16_t i = 0; i < h; i++) {
-        for (uint16_t j = 0; j < w / 8; j++) {
-            EPD_WriteByte(black ? black[j + i * wb] : 0xFF);
-        }
-    }
+    if (black)
+        EPD_WriteData(black, wb * h);
+    else
+        EPD_FillData(0xFF, wb * h);
     EPD_WriteCommand(CMD_WRITE_RAM2);
-    for (uint16_t i = 0; i < h; i++) {
-        for (uint16_t j = 0; j < w / 8; j++) {
-            if (EPD->bwr) {
-                EPD_WriteByte(color ? color[j + i * wb] : 0xFF);
-            } else {
-                EPD_WriteByte(black[j + i * wb]);
-            }
-        }
+    if (EPD->bwr) {
+        if (color)
+            EPD_WriteData(color, wb * h);
+        else
+            EPD_FillData(0xFF, wb * h);
+    } else {
+        EPD_WriteData(black, wb * h);
+        _overwriteSyncWindows(x, y, w, h);
     }
 }
 
@@ -175,6 +389,33 @@ void SSD1619_Sleep(void)
     delay(100);
 }
 
+void SSD1619_Write_Window(uint16_t x, uint16_t y, uint16_t w, uint16_t h, bool red)
+{
+    epd_model_t *EPD = epd_get();
+    w += x % 8; // byte boundary
+    x -= x % 8;
+    if (x + w > EPD->width || y + h > EPD->height || w == 0 || h == 0) return;
+
+    _setPartialRamArea(x, y, w, h); // until SSD1619_Write_Window_End or SSD1619_Refresh_End
+    EPD_WriteCommand(red ? CMD_WRITE_RAM2 : CMD_WRITE_RAM1);
+    _addSyncWindow(x, y, w, h, SYNC_COPY); // RAM2 on B/W panels too, it is restored from RAM1
+}
+
+void SSD1619_Write_Window_End(void)
+{
+    epd_model_t *EPD = epd_get();
+    _setPartialRamArea(0, 0, EPD->width, EPD->height);
+}
+
+void SSD1619_Write_Ram(bool red)
+{
+    epd_model_t *EPD = epd_get();
+
+    _setPartialRamArea(0, 0, EPD->width, EPD->height);
+    EPD_WriteCommand(red ? CMD_WRITE_RAM2 : CMD_WRITE_RAM1);
+    _addSyncWindow(0, 0, EPD->width, EPD->height, SYNC_COPY);
+}
+
 void SSD1619_Write_Partial_Image_Data(uint8_t *black, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
 {
     epd_model_t *EPD = epd_get();
@@ -185,26 +426,41 @@ void SSD1619_Write_Partial_Image_Data(uint8_t *black, uint16_t x, uint16_t y, ui
 
     _setPartialRamArea(x, y, w, h);
     EPD_WriteCommand(CMD_WRITE_RAM1);
-    for (uint16_t i = 0; i < h; i++) {
-        for (uint16_t j = 0; j < w / 8; j++) {
-            EPD_WriteByte(black[j + i * wb]);
-        }
+    EPD_WriteData(black, wb * h);
+    _addSyncWindow(x, y, w, h, SYNC_COPY);
+}
+
+// Checksum of RAM rows, lets the host skip sending an image that is
+// already in the panel, e.g. after the MCU was reset.
+uint16_t SSD1619_Ram_Checksum(bool red, uint16_t y, uint16_t h)
+{
+    epd_model_t *EPD = epd_get();
+    uint16_t wb = (EPD->width + 7) / 8;
+    uint16_t crc = 0xFFFF;
+    uint8_t buf[64];
+
+    if (y + h > EPD->height) return crc;
+    _setPartialRamArea(0, 0, EPD->width, EPD->height);
+    for (uint32_t offset = 0; offset < (uint32_t)wb * h; offset += sizeof(buf)) {
+        uint32_t n = (uint32_t)wb * h - offset;
+        if (n > sizeof(buf)) n = sizeof(buf);
+        _readRam(red, (offset % wb) * 8, y + offset / wb, buf, n);
+        crc = EPD_CRC16(crc, buf, n);
     }
+    _setRamPointer(0, 0); // image writes from the host start at the origin
+    return crc;
 }
 
+// SSD1619 has no refresh window, the area is not used. On B/W panels RAM2
+// holds the shown frame (see SSD1619_Sync_Ram2), so the mode 2 waveform only
+// drives the pixels of the windows written since the last refresh and one
+// activation covers all of them. B/W/R panels have the red plane in RAM2
+// and are refreshed over the whole screen.
 void SSD1619_Partial_Refresh_Area(uint16_t x, uint16_t y, uint16_t w, uint16_t h)
 {
-    // Reset (optional, depending on the specific partial refresh sequence)
-    // EPD_Reset(HIGH, 1); // Short reset
-    EPD_WriteCommand(CMD_BORDER_CTRL); // 0x3C
-    EPD_WriteByte(0x80);
-    EPD_WriteCommand(CMD_DRIVER_CTRL); // 0x01
-    EPD_WriteByte(0xF9);
-    EPD_WriteByte(0x00);
-    EPD_WriteByte(0x00);
-    _setPartialRamArea(x, y, w, h);
-    SSD1619_Update(0xff); // Trigger partial refresh
-    SSD1619_WaitBusy(30000); // Wait for busy signal
+    SSD1619_Refresh_Start(EPD_REFRESH_PARTIAL);
+    SSD1619_WaitBusy(30000);
+    SSD1619_Refresh_End();
 }
 
 static epd_driver_t epd_drv_ssd1619 = {
@@ -212,13 +468,22 @@ static epd_driver_t epd_drv_ssd1619 = {
     .clear = SSD1619_Clear,
     .write_image = SSD1619_Write_Image,
     .refresh = SSD1619_Refresh,
+    .refresh_start = SSD1619_Refresh_Start,
+    .refresh_end = SSD1619_Refresh_End,
     .sleep = SSD1619_Sleep,
     .read_temp = SSD1619_Read_Temp,
     .force_temp = SSD1619_Force_Temp,
     .write_partial_image = SSD1619_Write_Partial_Image_Data,
     .partial_refresh = SSD1619_Partial_Refresh_Area,
+    .fill_rect = SSD1619_Fill_Rect,
+    .ram_checksum = SSD1619_Ram_Checksum,
+    .write_window = SSD1619_Write_Window,
+    .write_window_end = SSD1619_Write_Window_End,
+    .write_ram = SSD1619_Write_Ram,
     .cmd_write_ram1 = CMD_WRITE_RAM1,
     .cmd_write_ram2 = CMD_WRITE_RAM2,
+    .busy_value = HIGH,
+    .sleep_keeps_ram = true, // deep sleep mode 1, SW reset leaves the RAM alone
 };
 
 // SSD1619 400x300 Black/White/Red
@@ -228,6 +493,7 @@ const epd_model_t epd_ssd1619_420_bwr = {
     .width = 400,
     .height = 300,
     .bwr = true,
+    .init_seq = init_seq_420,
 };
 
 // SSD1619 400x300 Black/White
@@ -237,6 +503,7 @@ const epd_model_t epd_ssd1619_420_bw = {
     .width = 400,
     .height = 300,
     .bwr = false,
+    .init_seq = init_seq_420,
 };
 
 // SSD1619 296x128 Black/White/Red
@@ -246,6 +513,7 @@ const epd_model_t epd_ssd1619_213_bwr = {
     .width = 136,
     .height = 250,
     .bwr = true,
+    .init_seq = init_seq_213,
 };
 
 
@@ -38,6 +38,11 @@
 #define CMD_DTM1    0x10        // Display Start Transmission 1
 #define CMD_DRF     0x12        // Display Refresh
 #define CMD_DTM2    0x13        // Display Start transmission 2 
+#define CMD_LUTC    0x20        // VCOM LUT
+#define CMD_LUTWW   0x21        // W2W LUT
+#define CMD_LUTBW   0x22        // B2W LUT
+#define CMD_LUTWB   0x23        // W2B LUT
+#define CMD_LUTBB   0x24        // B2B LUT
 #define CMD_TSC     0x40        // Temperature Sensor Calibration
 #define CMD_CDI     0x50        // Vcom and data interval setting 
 #define CMD_PTL     0x90        // Partial Window
@@ -56,6 +61,21 @@
 #define PSR_SHD       BIT(1)
 #define PSR_RST       BIT(0)
 
+// partial update LUTs (B/W mode), the rest of each LUT is zero.
+// DTM1 holds the inverted new image, so every pixel in the window goes
+// through BW or WB and is driven to its new color in a single phase.
+#define LUTC_SIZE   44
+#define LUT_SIZE    42
+static const uint8_t lut_vcom_partial[] = {0x00, 0x19, 0x01, 0x00, 0x00, 0x01};
+static const uint8_t lut_ww_partial[]   = {0x00, 0x19, 0x01, 0x00, 0x00, 0x01};
+static const uint8_t lut_bw_partial[]   = {0x80, 0x19, 0x01, 0x00, 0x00, 0x01};
+static const uint8_t lut_wb_partial[]   = {0x40, 0x19, 0x01, 0x00, 0x00, 0x01};
+static const uint8_t lut_bb_partial[]   = {0x00, 0x19, 0x01, 0x00, 0x00, 0x01};
+
+static uint8_t m_psr;                   // PSR value of the full (OTP LUT) mode
+static uint8_t m_cdi;                   // CDI value of the full mode
+static uint16_t m_part_x, m_part_y, m_part_w, m_part_h; // union of the partial windows since the last refresh
+
 static void UC8176_WaitBusy(uint16_t timeout)
 {
     EPD_WaitBusy(LOW, timeout);
@@ -90,41 +110,98 @@ void UC8176_Force_Temp(int8_t value)
     EPD_WriteByte(value);
 }
 
-void UC8176_Refresh(void)
+static void _setPartialRamArea(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+
+static void UC8176_Write_LUT(uint8_t cmd, const uint8_t *lut, uint8_t len, uint8_t size)
+{
+    EPD_WriteCommand(cmd);
+    EPD_WriteData((uint8_t *)lut, len);
+    EPD_FillData(0x00, size - len);
+}
+
+// partial refresh of the window written by UC8176_Write_Partial_Image,
+// B/W panels use the fast register LUT, B/W/R panels the OTP waveform
+static void UC8176_Refresh_Start(epd_refresh_mode_t mode)
 {
-    NRF_LOG_DEBUG("[EPD]: refresh begin\n");
+    epd_model_t *EPD = epd_get();
+    bool partial = mode == EPD_REFRESH_PARTIAL && m_part_w > 0;
+
+    NRF_LOG_DEBUG("[EPD]: refresh begin, mode %d\n", mode);
+    EPD_WriteCommand(CMD_PTOUT); // a UC8176_Write_Window may not be ended yet
+    if (partial && !EPD->bwr) {
+        EPD_WriteCommand(CMD_PSR);
+        EPD_WriteByte(m_psr | PSR_REG);
+        EPD_WriteCommand(CMD_CDI);
+        EPD_WriteByte(0x17); // border floating
+        UC8176_Write_LUT(CMD_LUTC, lut_vcom_partial, sizeof(lut_vcom_partial), LUTC_SIZE);
+        UC8176_Write_LUT(CMD_LUTWW, lut_ww_partial, sizeof(lut_ww_partial), LUT_SIZE);
+        UC8176_Write_LUT(CMD_LUTBW, lut_bw_partial, sizeof(lut_bw_partial), LUT_SIZE);
+        UC8176_Write_LUT(CMD_LUTWB, lut_wb_partial, sizeof(lut_wb_partial), LUT_SIZE);
+        UC8176_Write_LUT(CMD_LUTBB, lut_bb_partial, sizeof(lut_bb_partial), LUT_SIZE);
+    }
     UC8176_PowerOn();
-    NRF_LOG_DEBUG("[EPD]: temperature: %d\n", UC8176_Read_Temp());
+    if (partial) {
+        EPD_WriteCommand(CMD_PTIN);
+        _setPartialRamArea(m_part_x, m_part_y, m_part_w, m_part_h);
+    }
     EPD_WriteCommand(CMD_DRF);
     delay(100);
-    UC8176_WaitBusy(30000);
+}
+
+static void UC8176_Refresh_End(void)
+{
+    if (m_part_w > 0) {
+        EPD_WriteCommand(CMD_PTOUT);
+        // back to OTP LUT for full refresh
+        EPD_WriteCommand(CMD_PSR);
+        EPD_WriteByte(m_psr);
+        EPD_WriteCommand(CMD_CDI);
+        EPD_WriteByte(m_cdi);
+        m_part_w = 0;
+    }
     UC8176_PowerOff();
     NRF_LOG_DEBUG("[EPD]: refresh end\n");
 }
 
-void UC8176_Init()
+void UC8176_Refresh(void)
 {
-    EPD_Reset(HIGH, 10);
+    UC8176_Refresh_Start(EPD_REFRESH_FULL);
+    UC8176_WaitBusy(30000);
+    UC8176_Refresh_End();
+}
 
-    epd_model_t *EPD = epd_get();
-    uint8_t psr = PSR_UD | PSR_SHL | PSR_SHD | PSR_RST;
-    if (!EPD->bwr) psr |= PSR_BWR;
-    if (EPD->width == 320 && EPD->height == 300) {
-        psr |= PSR_RES0;
-    } else if (EPD->width == 320 && EPD->height == 240) {
-        psr |= PSR_RES1;
-    } else if (EPD->width == 200 && EPD->height == 300) {
-        psr |= PSR_RES1 | PSR_RES0;
-    } else {
-        // default to 400x300
-    }
+// PSR resolution bits of a w x h panel, 400x300 is 00
+#define UC8176_PSR_RES(w, h)                                                        \
+    (((w) == 320 && (h) == 300) ? PSR_RES0 :                                        \
+     ((w) == 320 && (h) == 240) ? PSR_RES1 :                                        \
+     ((w) == 200 && (h) == 300) ? (PSR_RES1 | PSR_RES0) : 0)
 
-    NRF_LOG_DEBUG("[EPD]: PSR=%02x\n", psr);
-    EPD_WriteCommand(CMD_PSR);
-    EPD_WriteByte(psr);
+// init sequence of a w x h panel, psr holds the other PSR bits
+#define UC8176_INIT_SEQ(w, h, psr, cdi)                                             \
+    EPD_SEQ_RESET, 10,                                                              \
+    EPD_SEQ_CMD(1), CMD_PSR, (psr) | UC8176_PSR_RES(w, h),                          \
+    EPD_SEQ_CMD(1), CMD_CDI, (cdi),                                                 \
+    EPD_SEQ_END
 
-    EPD_WriteCommand(CMD_CDI);
-    EPD_WriteByte(EPD->bwr ? 0x77 : 0x97);
+static const uint8_t init_seq_420_bw[] = {
+    UC8176_INIT_SEQ(400, 300, PSR_UD | PSR_SHL | PSR_SHD | PSR_RST | PSR_BWR, 0x97)
+};
+static const uint8_t init_seq_420_bwr[] = {
+    UC8176_INIT_SEQ(400, 300, PSR_UD | PSR_SHL | PSR_SHD | PSR_RST, 0x77)
+};
+
+void UC8176_Init()
+{
+    const uint8_t *seq = EPD_InitSequence();
+    int16_t psr = EPD_SequenceParam(seq, CMD_PSR);
+    int16_t cdi = EPD_SequenceParam(seq, CMD_CDI);
+
+    EPD_RunSequence(seq);
+    // partial refresh switches the LUT source and border, PSR and CDI are restored afterwards
+    m_psr = psr < 0 ? (PSR_UD | PSR_SHL | PSR_SHD | PSR_RST | UC8176_PSR_RES(epd_get()->width, epd_get()->height)) : psr;
+    m_cdi = cdi < 0 ? (epd_get()->bwr ? 0x77 : 0x97) : cdi;
+    m_part_w = 0;
+    NRF_LOG_DEBUG("[EPD]: PSR=%02x CDI=%02x\n", m_psr, m_cdi);
 }
 
 static void UC8176_Write_RAM(uint8_t cmd, uint8_t value)
@@ -134,11 +211,7 @@ static void UC8176_Write_RAM(uint8_t cmd, uint8_t value)
     uint16_t Height = EPD->height;
 
     EPD_WriteCommand(cmd);
-    for (uint16_t j = 0; j < Height; j++) {
-        for (uint16_t i = 0; i < Width; i++) {
-            EPD_WriteByte(value);
-        }
-    }
+    EPD_FillData(value, Width * Height);
 }
 
 void UC8176_Clear(bool refresh)
@@ -178,25 +251,121 @@ void UC8176_Write_Image(uint8_t *black, uint8_t *color, uint16_t x, uint16_t y,
     _setPartialRamArea(x, y, w, h);
     if (EPD->bwr) {
         EPD_WriteCommand(CMD_DTM1);
-        for (uint16_t i = 0; i < h; i++) {
-            for (uint16_t j = 0; j < w / 8; j++) {
-                EPD_WriteByte(black ? black[j + i * wb] : 0xFF);
-            }
-        }
+        if (black)
+            EPD_WriteData(black, wb * h);
+        else
+            EPD_FillData(0xFF, wb * h);
     }
     EPD_WriteCommand(CMD_DTM2);
-    for (uint16_t i = 0; i < h; i++) {
-        for (uint16_t j = 0; j < w / 8; j++) {
-            if (EPD->bwr) {
-                EPD_WriteByte(color ? color[j + i * wb] : 0xFF);
-            } else {
-                EPD_WriteByte(black[j + i * wb]);
-            }
+    if (EPD->bwr) {
+        if (color)
+            EPD_WriteData(color, wb * h);
+        else
+            EPD_FillData(0xFF, wb * h);
+    } else {
+        EPD_WriteData(black, wb * h);
+    }
+    EPD_WriteCommand(CMD_PTOUT); // partial out
+}
+
+// grow the partial window to cover another area, the controller has one
+// partial window and the refresh time doesn't depend on its size
+static void UC8176_Add_Partial_Window(uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    if (m_part_w > 0) {
+        uint16_t xe = (x + w > m_part_x + m_part_w) ? x + w : m_part_x + m_part_w;
+        uint16_t ye = (y + h > m_part_y + m_part_h) ? y + h : m_part_y + m_part_h;
+        if (m_part_x < x) x = m_part_x;
+        if (m_part_y < y) y = m_part_y;
+        w = xe - x;
+        h = ye - y;
+    }
+    m_part_x = x;
+    m_part_y = y;
+    m_part_w = w;
+    m_part_h = h;
+}
+
+void UC8176_Write_Partial_Image(uint8_t *black, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    epd_model_t *EPD = epd_get();
+    uint16_t wb = (w + 7) / 8;
+    x -= x % 8;
+    w = wb * 8;
+    if (x + w > EPD->width || y + h > EPD->height) return;
+
+    EPD_WriteCommand(CMD_PTIN); // partial in
+    _setPartialRamArea(x, y, w, h);
+    EPD_WriteCommand(CMD_DTM1);
+    if (EPD->bwr) {
+        EPD_WriteData(black, wb * h);
+    } else {
+        // old data = inverted new data, see the partial LUTs
+        uint8_t buf[32];
+        for (uint16_t i = 0, n; i < wb * h; i += n) {
+            n = wb * h - i > sizeof(buf) ? sizeof(buf) : wb * h - i;
+            for (uint16_t j = 0; j < n; j++) buf[j] = ~black[i + j];
+            EPD_WriteData(buf, n);
         }
     }
+    EPD_WriteCommand(CMD_DTM2);
+    if (EPD->bwr)
+        EPD_FillData(0xFF, wb * h); // no red
+    else
+        EPD_WriteData(black, wb * h);
+    EPD_WriteCommand(CMD_PTOUT); // partial out
+
+    UC8176_Add_Partial_Window(x, y, w, h);
+}
+
+void UC8176_Write_Window(uint16_t x, uint16_t y, uint16_t w, uint16_t h, bool red)
+{
+    epd_model_t *EPD = epd_get();
+    w += x % 8; // byte boundary
+    x -= x % 8;
+    if (x + w > EPD->width || y + h > EPD->height || w == 0 || h == 0) return;
+
+    EPD_WriteCommand(CMD_PTIN); // partial in, until UC8176_Write_Window_End or the refresh
+    _setPartialRamArea(x, y, w, h);
+    EPD_WriteCommand(red ? CMD_DTM2 : CMD_DTM1);
+    UC8176_Add_Partial_Window(x, y, w, h);
+}
+
+// the window data is kept, the partial refresh still covers it
+void UC8176_Write_Window_End(void)
+{
     EPD_WriteCommand(CMD_PTOUT); // partial out
 }
 
+void UC8176_Fill_Rect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, epd_color_t color)
+{
+    epd_model_t *EPD = epd_get();
+    bool red = EPD->bwr && color == EPD_COLOR_RED;
+    bool white = color == EPD_COLOR_WHITE || red;
+    w += x % 8; // byte boundary
+    x -= x % 8;
+    if (x >= EPD->width || y >= EPD->height || w == 0 || h == 0) return;
+    if (x + w > EPD->width) w = EPD->width - x;
+    if (y + h > EPD->height) h = EPD->height - y;
+    uint16_t wb = (w + 7) / 8;
+
+    EPD_WriteCommand(CMD_PTIN); // partial in
+    _setPartialRamArea(x, y, w, h);
+    EPD_WriteCommand(CMD_DTM1);
+    EPD_FillData(white ? 0xFF : 0x00, wb * h);
+    EPD_WriteCommand(CMD_DTM2);
+    EPD_FillData((EPD->bwr ? !red : white) ? 0xFF : 0x00, wb * h);
+    EPD_WriteCommand(CMD_PTOUT); // partial out
+}
+
+void UC8176_Partial_Refresh_Area(uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    UC8176_Add_Partial_Window(x & 0xFFF8, y, w + (x & 0x0007), h);
+    UC8176_Refresh_Start(EPD_REFRESH_PARTIAL);
+    UC8176_WaitBusy(30000);
+    UC8176_Refresh_End();
+}
+
 void UC8176_Sleep(void)
 {
     UC8176_PowerOff();
@@ -211,11 +380,19 @@ static epd_driver_t epd_drv_uc8176 = {
     .clear = UC8176_Clear,
     .write_image = UC8176_Write_Image,
     .refresh = UC8176_Refresh,
+    .refresh_start = UC8176_Refresh_Start,
+    .refresh_end = UC8176_Refresh_End,
     .sleep = UC8176_Sleep,
     .read_temp = UC8176_Read_Temp,
     .force_temp = UC8176_Force_Temp,
+    .write_partial_image = UC8176_Write_Partial_Image,
+    .partial_refresh = UC8176_Partial_Refresh_Area,
+    .fill_rect = UC8176_Fill_Rect,
+    .write_window = UC8176_Write_Window,
+    .write_window_end = UC8176_Write_Window_End,
     .cmd_write_ram1 = CMD_DTM1,
     .cmd_write_ram2 = CMD_DTM2,
+    .busy_value = LOW,
 };
 
 // UC8176 400x300 Black/White
@@ -225,6 +402,7 @@ const epd_model_t epd_uc8176_420_bw = {
     .width = 400,
     .height = 300,
     .bwr = false,
+    .init_seq = init_seq_420_bw,
 };
 
 // UC8176 400x300 Black/White/Red
@@ -234,4 +412,5 @@ const epd_model_t epd_uc8176_420_bwr = {
     .width = 400,
     .height = 300,
     .bwr = true,
+    .init_seq = init_seq_420_bwr,
 };
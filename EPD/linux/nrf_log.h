@@ -0,0 +1,16 @@
+// nrf_log replacement for host builds (Makefile.linux)
+#ifndef NRF_LOG_H_
+#define NRF_LOG_H_
+
+#include <stdio.h>
+
+#if defined(EPD_LOG_ENABLED) && EPD_LOG_ENABLED
+#define NRF_LOG_DEBUG(...)  printf(__VA_ARGS__)
+#define NRF_LOG_INFO(...)   printf(__VA_ARGS__)
+#else
+#define NRF_LOG_DEBUG(...)
+#define NRF_LOG_INFO(...)
+#endif
+#define NRF_LOG_HEXDUMP_DEBUG(p_data, len)
+
+#endif
@@ -114,11 +114,100 @@ void GFX_firstPage(Adafruit_GFX *gfx) {
   gfx->current_page = 0;
 }
 
+/**************************************************************************/
+/*!
+   @brief    Track changed tiles, pages will only send the columns that
+             differ from the previous frame drawn with the same map
+   @param    map   Signatures kept by the caller between frames
+*/
+/**************************************************************************/
+void GFX_setDirtyMap(Adafruit_GFX *gfx, GFX_DirtyMap *map) {
+  int16_t column_bytes = ((gfx->WIDTH + 7) / 8 + GFX_DIRTY_COLUMNS - 1) / GFX_DIRTY_COLUMNS;
+  if (gfx->total_pages > GFX_DIRTY_MAX_PAGES) return;
+  if (map->page_height != gfx->page_height || map->column_bytes != column_bytes) {
+    GFX_invalidate(map);
+    map->page_height = gfx->page_height;
+    map->column_bytes = column_bytes;
+  }
+  gfx->dirty = map;
+}
+
+/**************************************************************************/
+/*!
+   @brief    Send the whole next frame, e.g. after the display RAM was
+             written by someone else
+*/
+/**************************************************************************/
+void GFX_invalidate(GFX_DirtyMap *map) {
+  map->valid = false;
+}
+
+/**************************************************************************/
+/*!
+   @brief    Send the tiles covering an area (raw display coordinates)
+             with the next frame
+*/
+/**************************************************************************/
+void GFX_invalidateRect(GFX_DirtyMap *map, int16_t x, int16_t y, int16_t w, int16_t h) {
+  if (!map->valid || w <= 0 || h <= 0) return;
+  int16_t c0 = x / 8 / map->column_bytes;
+  int16_t c1 = MIN((x + w - 1) / 8 / map->column_bytes, GFX_DIRTY_COLUMNS - 1);
+  uint8_t bits = (uint8_t)(((1 << (c1 + 1)) - 1) & ~((1 << c0) - 1));
+  for (int16_t p = y / map->page_height; p <= (y + h - 1) / map->page_height && p < GFX_DIRTY_MAX_PAGES; p++)
+    map->stale[p] |= bits;
+}
+
+static uint16_t GFX_tileSignature(uint8_t *buf, int16_t stride, int16_t x, int16_t w, int16_t h) {
+  uint32_t hash = 2166136261UL; // FNV-1a
+  for (int16_t row = 0; row < h; row++) {
+    uint8_t *p = buf + row * stride + x;
+    for (int16_t i = 0; i < w; i++)
+      hash = (hash ^ p[i]) * 16777619UL;
+  }
+  return (uint16_t)(hash ^ (hash >> 16));
+}
+
+static void GFX_sendDirty(Adafruit_GFX *gfx, buffer_callback callback, int16_t page_y, int16_t height) {
+  GFX_DirtyMap *map = gfx->dirty;
+  int16_t page = gfx->current_page;
+  int16_t wb = (gfx->WIDTH + 7) / 8;
+  int16_t cb = map->column_bytes;
+  int16_t first = -1, last = -1;
+
+  for (int16_t c = 0; c * cb < wb; c++) {
+    int16_t n = MIN(cb, wb - c * cb);
+    uint16_t sig = GFX_tileSignature(gfx->buffer, wb, c * cb, n, height);
+    if (gfx->color) sig ^= GFX_tileSignature(gfx->color, wb, c * cb, n, height) * 31;
+    if (!map->valid || (map->stale[page] & (1 << c)) || map->sig[page][c] != sig) {
+      if (first < 0) first = c;
+      last = c;
+    }
+    map->sig[page][c] = sig;
+  }
+  map->stale[page] = 0;
+  if (first < 0 || callback == NULL) return;
+
+  // move the dirty columns to the start of the page buffers
+  int16_t x = first * cb;
+  int16_t n = MIN(wb, (last + 1) * cb) - x;
+  if (n < wb) {
+    for (int16_t row = 0; row < height; row++) {
+      memmove(gfx->buffer + row * n, gfx->buffer + row * wb + x, n);
+      if (gfx->color) memmove(gfx->color + row * n, gfx->color + row * wb + x, n);
+    }
+  }
+  callback(gfx->buffer, gfx->color, x * 8, page_y, MIN(n * 8, gfx->WIDTH - x * 8), height);
+}
+
 bool GFX_nextPage(Adafruit_GFX *gfx, buffer_callback callback) {
   int16_t page_y = gfx->current_page * gfx->page_height;
   int16_t height = MIN(gfx->page_height, gfx->HEIGHT - page_y);
-  if (callback)
+  if (gfx->dirty)
+    GFX_sendDirty(gfx, callback, page_y, height);
+  else if (callback)
     callback(gfx->buffer, gfx->color, 0, page_y, gfx->WIDTH, height);
+  if (gfx->dirty && gfx->current_page + 1 == gfx->total_pages)
+    gfx->dirty->valid = true;
 
   gfx->current_page++;
   GFX_fillScreen(gfx, GFX_WHITE);
@@ -257,7 +346,7 @@ void GFX_drawLine(Adafruit_GFX *gfx, int16_t x0, int16_t y0, int16_t x1, int16_t
 /**************************************************************************/
 void GFX_drawFastVLine(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t h,
                        uint16_t color) {
-  GFX_drawLine(gfx, x, y, x, y + h - 1, color);
+  GFX_fillRect(gfx, x, y, 1, h, color);
 }
 
 /**************************************************************************/
@@ -271,7 +360,37 @@ void GFX_drawFastVLine(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t h,
 /**************************************************************************/
 void GFX_drawFastHLine(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w,
                        uint16_t color) {
-  GFX_drawLine(gfx, x, y, x + w - 1, y, color);
+  GFX_fillRect(gfx, x, y, w, 1, color);
+}
+
+// set or clear bits x0 .. x1 - 1 of a buffer row, whole bytes with memset
+static void GFX_fillBits(uint8_t *row, int16_t x0, int16_t x1, bool set) {
+  int16_t b0 = x0 / 8, b1 = (x1 - 1) / 8;
+  uint8_t m0 = 0xFF >> (x0 & 7);
+  uint8_t m1 = 0xFF << (7 - ((x1 - 1) & 7));
+  if (b0 == b1) m0 &= m1;
+  if (set) row[b0] |= m0; else row[b0] &= ~m0;
+  if (b0 == b1) return;
+  if (b1 > b0 + 1) memset(row + b0 + 1, set ? 0xFF : 0x00, b1 - b0 - 1);
+  if (set) row[b1] |= m1; else row[b1] &= ~m1;
+}
+
+// fill a rectangle in raw display coordinates, clipped to the current page
+static void GFX_fillRawRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w, int16_t h,
+                            uint16_t color) {
+  int16_t stride = (gfx->WIDTH + 7) / 8;
+  int16_t y0 = y - gfx->current_page * gfx->page_height;
+  int16_t y1 = y0 + h;
+  if (y0 < 0) y0 = 0;
+  if (y1 > gfx->page_height) y1 = gfx->page_height;
+
+  // same color rules as GFX_drawPixel
+  bool bw_set = gfx->color != NULL ? color != GFX_BLACK : color == GFX_WHITE;
+  bool red_set = color != GFX_RED;
+  for (int16_t row = y0; row < y1; row++) {
+    GFX_fillBits(gfx->buffer + row * stride, x, x + w, bw_set);
+    if (gfx->color != NULL) GFX_fillBits(gfx->color + row * stride, x, x + w, red_set);
+  }
 }
 
 /**************************************************************************/
@@ -286,8 +405,29 @@ void GFX_drawFastHLine(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w,
 /**************************************************************************/
 void GFX_fillRect(Adafruit_GFX *gfx, int16_t x, int16_t y, int16_t w, int16_t h,
                   uint16_t color) {
-  for (int16_t i = x; i < x + w; i++) {
-    GFX_drawFastVLine(gfx, i, y, h, color);
+  if (w < 0) { x += w + 1; w = -w; }
+  if (h < 0) { y += h + 1; h = -h; }
+  if (x < 0) { w += x; x = 0; }
+  if (y < 0) { h += y; y = 0; }
+  if (x + w > gfx->_width) w = gfx->_width - x;
+  if (y + h > gfx->_height) h = gfx->_height - y;
+  if (w <= 0 || h <= 0) return;
+
+  // rotate the rectangle once instead of every pixel, rows of the raw
+  // display then become byte-wide fills
+  switch (gfx->rotation) {
+    case GFX_ROTATE_0:
+      GFX_fillRawRect(gfx, x, y, w, h, color);
+      break;
+    case GFX_ROTATE_90:
+      GFX_fillRawRect(gfx, gfx->WIDTH - y - h, x, h, w, color);
+      break;
+    case GFX_ROTATE_180:
+      GFX_fillRawRect(gfx, gfx->WIDTH - x - w, gfx->HEIGHT - y - h, w, h, color);
+      break;
+    case GFX_ROTATE_270:
+      GFX_fillRawRect(gfx, y, gfx->HEIGHT - x - w, h, w, color);
+      break;
   }
 }
 
@@ -12,6 +12,19 @@
 
 typedef void (*buffer_callback)(uint8_t *black, uint8_t *color, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
 
+#define GFX_DIRTY_MAX_PAGES 20
+#define GFX_DIRTY_COLUMNS   8
+
+// Signatures of the frame last sent to the display, one per tile
+// (page band x column group), so unchanged tiles can be skipped.
+typedef struct {
+  uint16_t sig[GFX_DIRTY_MAX_PAGES][GFX_DIRTY_COLUMNS];
+  uint8_t stale[GFX_DIRTY_MAX_PAGES]; // tiles to send anyway, bit per column group
+  int16_t page_height;  // geometry the signatures belong to
+  int16_t column_bytes;
+  bool valid;
+} GFX_DirtyMap;
+
 typedef enum {
   GFX_ROTATE_0   = 0,
   GFX_ROTATE_90  = 1,
@@ -37,6 +50,7 @@ typedef struct {
   int16_t page_height;
   int16_t current_page;
   int16_t total_pages;
+  GFX_DirtyMap *dirty;  // send only changed tiles if set
 } Adafruit_GFX;
 
 // CONTROL API
@@ -46,6 +60,9 @@ void GFX_setRotation(Adafruit_GFX *gfx, GFX_Rotate r);
 void GFX_firstPage(Adafruit_GFX *gfx);
 bool GFX_nextPage(Adafruit_GFX *gfx, buffer_callback callback);
 void GFX_end(Adafruit_GFX *gfx);
+void GFX_setDirtyMap(Adafruit_GFX *gfx, GFX_DirtyMap *map);
+void GFX_invalidate(GFX_DirtyMap *map);
+void GFX_invalidateRect(GFX_DirtyMap *map, int16_t x, int16_t y, int16_t w, int16_t h);
 
 // DRAW API
 void GFX_drawPixel(Adafruit_GFX *gfx, int16_t x, int16_t y, uint16_t color);
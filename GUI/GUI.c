@@ -91,11 +91,12 @@ static bool GetFestival(uint16_t year, uint8_t mon, uint8_t day, uint8_t week,
     return false;
 }
 
-static void DrawBattery(Adafruit_GFX *gfx, int16_t x, int16_t y, float voltage) {
-    uint8_t level = (uint8_t)(voltage * 100 / 4.2);
+static void DrawBattery(Adafruit_GFX *gfx, int16_t x, int16_t y, uint16_t voltage) {
+    uint8_t level = voltage >= 4200 ? 100 : voltage * 100 / 4200;
     GFX_setCursor(gfx, x - 26, y + 9);
     GFX_setFont(gfx, u8g2_font_wqy9_t_lunar);
-    GFX_printf(gfx, "%.1fV", voltage);
+    uint16_t decivolt = (voltage + 50) / 100;
+    GFX_printf(gfx, "%d.%dV", decivolt / 10, decivolt % 10);
     GFX_fillRect(gfx, x, y, 20, 10, GFX_WHITE);
     GFX_drawRect(gfx, x, y, 20, 10, GFX_BLACK);
     GFX_fillRect(gfx, x + 20, y + 4, 2, 2, GFX_BLACK);
@@ -310,6 +311,8 @@ void DrawGUITime(gui_data_t *data, void (*write_partial_image)(uint8_t*, uint16_
 
     // 调用驱动函数，将我们自己绘制好的缓冲区数据写入屏幕
     write_partial_image(local_buffer, 188, 35, digit_width, digit_height);
+    // 屏幕内存已和上次整屏绘制的内容不同，下次整屏绘制需要重新发送
+    if (data->dirty) GFX_invalidateRect(data->dirty, 188, 35, digit_width, digit_height);
 
     // 释放内存
     free(local_buffer);
@@ -336,6 +339,7 @@ void DrawGUI(gui_data_t *data, buffer_callback draw, display_mode_t mode)
       GFX_begin(&gfx, data->width, data->height, PAGE_HEIGHT);
       
     GFX_setRotation(&gfx, GFX_ROTATE_270);
+    if (data->dirty) GFX_setDirtyMap(&gfx, data->dirty);
 
     GFX_firstPage(&gfx);
     do {
@@ -19,7 +19,8 @@ typedef struct {
     uint16_t height;
     uint32_t timestamp;
     int8_t temperature;
-    float voltage;
+    uint16_t voltage; // mV
+    GFX_DirtyMap *dirty; // 为 NULL 时发送整页，否则只发送有变化的区域
 } gui_data_t;
 
 void DrawGUI(gui_data_t *data, buffer_callback draw, display_mode_t mode);
@@ -0,0 +1,150 @@
+// EPD driver benchmark for Linux
+// Runs the panel drivers against the recording HAL backend and prints the SPI
+// traffic of a full GUI update, so driver changes can be compared off-target.
+#include <stdio.h>
+#include <string.h>
+#include "EPD_driver.h"
+#include "EPD_hal_linux.h"
+#include "GUI.h"
+
+#define BENCH_TIMESTAMP 1735689600 // 2025-01-01 00:00:00
+#define BENCH_CHUNK_SIZE 242       // WRITE_IMAGE payload with the nRF52 MTU
+
+typedef struct {
+    epd_model_id_t id;
+    const char *name;
+    uint32_t busy_value;   // BUSY level while the panel is busy
+    uint8_t refresh_cmd;   // command that starts the display update
+    uint32_t refresh_ms;   // simulated waveform duration
+    uint32_t mode2_ms;     // SSD1619 display mode 2 (0x22 sequence with 0x08) waveform duration
+    uint32_t poweroff_ms;  // SSD1619 power off (0x22 sequence 0x83) duration
+} bench_model_t;
+
+static const bench_model_t models[] = {
+    { EPD_UC8176_420_BW,   "UC8176 4.2\" BW",    LOW,  0x12, 3000,  0,   0  },
+    { EPD_UC8176_420_BWR,  "UC8176 4.2\" BWR",   LOW,  0x12, 15000, 0,   0  },
+    { EPD_SSD1619_420_BWR, "SSD1619 4.2\" BWR",  HIGH, 0x20, 15000, 600, 20 },
+    { EPD_SSD1619_420_BW,  "SSD1619 4.2\" BW",   HIGH, 0x20, 3000,  600, 20 },
+    { EPD_SSD1619_213_BWR, "SSD1619 2.13\" BWR", HIGH, 0x20, 15000, 600, 20 },
+};
+
+static void print_stats(const char *step)
+{
+    epd_hal_linux_stats_t *stats = epd_hal_linux_stats();
+    printf("  %-10s cmds %5u  data %6u B  read %3u B  xfers %5u  busy %6u ms  delay %5u ms\n",
+           step, stats->commands, stats->data_bytes, stats->read_bytes,
+           stats->transactions, stats->busy_ms, stats->delay_ms);
+    epd_hal_linux_stats_reset();
+}
+
+static void bench_model(const bench_model_t *model, display_mode_t mode)
+{
+    epd_config_t cfg = {0x14, 0x13, 0x06, 0x05, 0x04, 0x03, 0x02, model->id, 0xFF, 0xFF, 0xFF};
+
+    printf("%s\n", model->name);
+    epd_hal_linux_init(&cfg, model->busy_value);
+    epd_hal_linux_busy_cmd(model->refresh_cmd, model->refresh_ms);
+    if (model->mode2_ms) epd_hal_linux_busy_param(model->refresh_cmd, 0x22, 0x08, model->mode2_ms);
+    if (model->poweroff_ms) epd_hal_linux_busy_value(model->refresh_cmd, 0x22, 0x83, model->poweroff_ms);
+    epd_hal_linux_stats_reset();
+
+    EPD_GPIO_Init();
+    epd_model_t *epd = epd_init(model->id);
+    print_stats("init");
+
+    gui_data_t data = {
+        .bwr             = epd->bwr,
+        .width           = epd->width,
+        .height          = epd->height,
+        .timestamp       = BENCH_TIMESTAMP,
+        .temperature     = EPD_ReadTemp(),
+        .voltage         = EPD_ReadVoltage(),
+    };
+    DrawGUI(&data, epd->drv->write_image, mode);
+    print_stats("draw");
+
+    // next clock tick with dirty tracking, first frame sends everything
+    GFX_DirtyMap dirty = {0};
+    data.dirty = &dirty;
+    DrawGUI(&data, NULL, mode);
+    data.timestamp += 600;
+    DrawGUI(&data, epd->drv->write_image, mode);
+    print_stats("redraw");
+    data.dirty = NULL;
+
+    epd->drv->refresh();
+    print_stats("refresh");
+
+    epd_refresh_async(EPD_REFRESH_FAST, NULL, NULL);
+    print_stats("fast");
+
+    if (model->mode2_ms && !epd->bwr) {
+        // same frame streamed to RAM1 in BLE sized chunks, then only changed pixels are driven
+        uint8_t chunk[BENCH_CHUNK_SIZE];
+        uint32_t size = (epd->width + 7) / 8 * epd->height;
+        memset(chunk, 0xFF, sizeof(chunk));
+        epd->drv->write_ram(false);
+        for (uint32_t i = 0; i < size; i += sizeof(chunk))
+            EPD_WriteData(chunk, size - i > sizeof(chunk) ? sizeof(chunk) : size - i);
+        epd_refresh_async(EPD_REFRESH_DIFF, NULL, NULL);
+        print_stats("diff");
+    }
+
+    if (epd->drv->write_partial_image) {
+        // minute digit and a status icon area, shown by one activation
+        uint8_t icon[4 * 16];
+        memset(icon, 0xFF, sizeof(icon));
+        data.bwr = false;
+        DrawGUITime(&data, epd->drv->write_partial_image);
+        epd->drv->write_partial_image(icon, 8, epd->height - 24, 32, 16);
+        epd_refresh_async(EPD_REFRESH_PARTIAL, NULL, NULL);
+        print_stats("partial");
+    }
+
+    if (epd->drv->write_window) {
+        // price label sized crop from the host instead of the whole frame
+        uint8_t crop[8 * 32];
+        memset(crop, 0x00, sizeof(crop));
+        epd->drv->write_window(96, 64, 64, 32, false);
+        EPD_WriteData(crop, sizeof(crop));
+        epd_refresh_async(EPD_REFRESH_PARTIAL, NULL, NULL);
+        print_stats("region");
+    }
+
+    if (epd->drv->ram_checksum) {
+        // readback the host asks for before resending an image
+        for (uint16_t y = 0; y < epd->height; y += 16)
+            epd->drv->ram_checksum(false, y, epd->height - y > 16 ? 16 : epd->height - y);
+        print_stats("checksum");
+    }
+
+    epd->drv->clear(false);
+    print_stats("clear");
+
+    epd->drv->sleep();
+    print_stats("sleep");
+    EPD_GPIO_Uninit();
+}
+
+int main(int argc, char *argv[])
+{
+    display_mode_t mode = MODE_CALENDAR;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0)
+            epd_hal_linux_trace(stdout);
+        else if (strcmp(argv[i], "-c") == 0)
+            mode = MODE_CLOCK;
+        else {
+            printf("usage: %s [-t] [-c]\n", argv[0]);
+            printf("  -t  trace the command/data stream\n");
+            printf("  -c  draw clock mode instead of calendar\n");
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(models) / sizeof(models[0]); i++)
+        bench_model(&models[i], mode);
+
+    return 0;
+}
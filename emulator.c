@@ -185,7 +185,7 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
                 .height          = BITMAP_HEIGHT,
                 .timestamp       = g_display_time,
                 .temperature     = 25,
-                .voltage         = 3.2f,
+                .voltage         = 3200,
             };
             
             // Call DrawGUI to render the interface, passing the BWR mode
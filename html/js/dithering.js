@@ -82,6 +82,7 @@ function dithering(ctx, width, height, threshold, type) {
 }
 
 // white: 1, black/red: 0
+// gray1/gray2: high/low bit of the 4 level gray value (0 black, 3 white)
 function canvas2bytes(canvas, step = 'bw', invert = false) {
   const ctx = canvas.getContext("2d");
   const imageData = ctx.getImageData(0, 0, canvas.width, canvas.height);
@@ -94,6 +95,9 @@ function canvas2bytes(canvas, step = 'bw', invert = false) {
       const i = (canvas.width * y + x) * 4;
       if (step === 'bw') {
         buffer.push(imageData.data[i] === 0 && imageData.data[i+1] === 0 && imageData.data[i+2] === 0 ? 0 : 1);
+      } else if (step === 'gray1' || step === 'gray2') {
+        const level = Math.round(imageData.data[i] / 85);
+        buffer.push(step === 'gray1' ? level >> 1 : level & 1);
       } else {
         buffer.push(imageData.data[i] > 0 && imageData.data[i+1] === 0 && imageData.data[i+2] === 0 ? 0 : 1);
       }
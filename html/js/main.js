@@ -2,6 +2,11 @@ let bleDevice, gattServer;
 let epdService, epdCharacteristic;
 let startTime, msgIndex, appVersion;
 let canvas, ctx, textDecoder;
+let statsData = new Uint8Array(44);
+let ramChecksum = null;
+let ramChecksumSupported = true; // 驱动不支持读回时设备只回复 1 字节
+let credits = null, creditWaiter = null; // 流控额度，null 表示未开启
+let rxBusy = false; // 设备接收缓冲区将满
 
 const EpdCmd = {
   SET_PINS:  0x00,
@@ -11,14 +16,20 @@ const EpdCmd = {
   SEND_DATA: 0x04,
   REFRESH:   0x05,
   SLEEP:     0x06,
+  FILL:      0x07,
 
   SET_TIME:  0x20,
 
   WRITE_IMG: 0x30, // v1.6
+  RAM_CRC:   0x31,
+  WRITE_IMG_RLE: 0x32,
+  WRITE_REGION:  0x33,
 
   SET_CONFIG: 0x90,
   SYS_RESET:  0x91,
   SYS_SLEEP:  0x92,
+  GET_STATS:  0x93, // v1.8
+  FLOW_CTRL:  0x95,
   CFG_ERASE:  0x99,
 };
 
@@ -27,6 +38,9 @@ function resetVariables() {
   epdService = null;
   epdCharacteristic = null;
   msgIndex = 0;
+  credits = null;
+  rxBusy = false;
+  ramChecksumSupported = true;
   document.getElementById("log").value = '';
 }
 
@@ -42,6 +56,7 @@ async function write(cmd, data, withResponse=true) {
     payload.push(...data)
   }
   addLog(bytes2hex(payload), '⇑');
+  if (credits !== null) credits--;
   try {
     if (withResponse)
       await epdCharacteristic.writeValueWithResponse(Uint8Array.from(payload));
@@ -50,6 +65,7 @@ async function write(cmd, data, withResponse=true) {
   } catch (e) {
     console.error(e);
     if (e.message) addLog("write: " + e.message);
+    if (credits !== null) credits++;
     return false;
   }
   return true;
@@ -79,30 +95,158 @@ async function epdWrite(cmd, data) {
   }
 }
 
-async function epdWriteImage(step = 'bw') {
-  const data = canvas2bytes(canvas, step);
+// CRC-16/CCITT-FALSE, same as EPD_CRC16 in the firmware
+function crc16(data) {
+  let crc = 0xFFFF;
+  for (const byte of data) {
+    crc ^= byte << 8;
+    for (let i = 0; i < 8; i++)
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) & 0xFFFF : (crc << 1) & 0xFFFF;
+  }
+  return crc;
+}
+
+// 读回屏幕内存每段的 CRC，不支持或超时返回 null
+async function readRamChecksum(plane, rows) {
+  const bands = Math.ceil(canvas.height / rows);
+  const result = new Promise((resolve) => {
+    ramChecksum = { crcs: new Array(bands).fill(null), resolve };
+    setTimeout(() => resolve(null), 5000);
+  });
+  if (!await write(EpdCmd.RAM_CRC, [plane, rows])) ramChecksum.resolve(null);
+  const crcs = await result;
+  ramChecksum = null;
+  return crcs;
+}
+
+function handleRamChecksum(data) {
+  if (!ramChecksum) return;
+  if (data.length < 2) {
+    ramChecksumSupported = false; // 不再询问
+    return ramChecksum.resolve(null);
+  }
+  for (let i = 2; i + 1 < data.length; i += 2)
+    ramChecksum.crcs[data[1] + (i - 2) / 2] = (data[i] << 8) | data[i + 1];
+  if (ramChecksum.crcs.every(crc => crc !== null)) ramChecksum.resolve(ramChecksum.crcs);
+}
+
+// 屏幕内存里已经是这张图片（比如设备重启后重发同一张图）
+async function ramUnchanged(data, plane) {
+  const rows = 16;
+  const bytes = rows * Math.ceil(canvas.width / 8);
+  const crcs = await readRamChecksum(plane, rows);
+  return crcs != null && crcs.every((crc, i) => crc == crc16(data.slice(i * bytes, (i + 1) * bytes)));
+}
+
+// PackBits, the firmware decodes it as the packets arrive
+function packbits(data) {
+  const out = [];
+  let i = 0;
+  while (i < data.length) {
+    let run = 1;
+    while (i + run < data.length && run < 128 && data[i + run] == data[i]) run++;
+    if (run >= 3) {
+      out.push(257 - run, data[i]);
+      i += run;
+      continue;
+    }
+    // literal up to the next run of 3 bytes
+    const start = i;
+    while (i < data.length && i - start < 128) {
+      if (i + 2 < data.length && data[i] == data[i + 1] && data[i] == data[i + 2]) break;
+      i++;
+    }
+    out.push(i - start - 1, ...data.slice(start, i));
+  }
+  return out;
+}
+
+// 画布上的矩形区域，x 和宽度对齐到字节
+function getRegion() {
+  const value = document.getElementById('region').value.trim();
+  if (value == '') return null;
+  let [x, y, w, h] = value.split(',').map(v => parseInt(v));
+  if ([x, y, w, h].some(v => isNaN(v) || v < 0) || w == 0 || h == 0) return null;
+  w += x % 8;
+  x -= x % 8;
+  w = Math.min(Math.ceil(w / 8) * 8, canvas.width - x);
+  h = Math.min(h, canvas.height - y);
+  return w > 0 && h > 0 ? { x, y, w, h } : null;
+}
+
+function cropCanvas(region) {
+  const crop = document.createElement('canvas');
+  crop.width = region.w;
+  crop.height = region.h;
+  crop.getContext('2d').putImageData(ctx.getImageData(region.x, region.y, region.w, region.h), 0, 0);
+  return crop;
+}
+
+// 等待设备归还额度，超时后关闭流控，改用带响应写入
+async function waitCredit() {
+  if (credits === null || credits > 0) return;
+  const ok = await new Promise(resolve => {
+    creditWaiter = resolve;
+    setTimeout(() => resolve(false), 3000);
+  });
+  creditWaiter = null;
+  if (!ok) {
+    addLog("等待流控额度超时，改用带响应写入");
+    credits = null;
+  }
+}
+
+// region: 只写屏幕内存的这个区域，plane 为写入的内存（0 黑白/1 红色）
+async function epdWriteImage(step = 'bw', region = null, plane = step == 'red' ? 1 : 0, invert = false) {
+  let data = canvas2bytes(region ? cropCanvas(region) : canvas, step, invert);
+  if (region) {
+    const rect = [region.x, region.y, region.w, region.h].flatMap(v => [(v >> 8) & 0xFF, v & 0xFF]);
+    await write(EpdCmd.WRITE_REGION, [plane, ...rect]);
+  } else if (appVersion >= 0x1D && ramChecksumSupported && document.getElementById('skipunchanged').checked &&
+             (step == 'bw' || step == 'red') && await ramUnchanged(data, step == 'red' ? 1 : 0)) {
+    addLog(`屏幕内存中的${step == 'red' ? '红色' : '黑白'}数据未变化，跳过发送`);
+    return;
+  }
+  const cmd = appVersion >= 0x1E ? EpdCmd.WRITE_IMG_RLE : EpdCmd.WRITE_IMG;
+  if (cmd == EpdCmd.WRITE_IMG_RLE) {
+    const size = data.length;
+    data = packbits(data);
+    addLog(`压缩: ${size} → ${data.length} 字节 (${(data.length * 100 / size).toFixed(1)}%)`);
+  }
+  const flag = { bw: 0x0F, gray1: 0x0F, gray2: 0x00, red: 0x00 }[step];
   const chunkSize = document.getElementById('mtusize').value - 2;
   const interleavedCount = document.getElementById('interleavedcount').value;
   const count = Math.round(data.length / chunkSize);
   let chunkIdx = 0;
   let noReplyCount = interleavedCount;
+  const writeStart = new Date().getTime();
 
   for (let i = 0; i < data.length; i += chunkSize) {
     let currentTime = (new Date().getTime() - startTime) / 1000.0;
-    setStatus(`${step == 'bw' ? '黑白' : '红色'}块: ${chunkIdx+1}/${count+1}, 总用时: ${currentTime}s`);
+    setStatus(`${step == 'red' ? '红色' : step.startsWith('gray') ? '灰度' : '黑白'}块: ${chunkIdx+1}/${count+1}, 总用时: ${currentTime}s`);
     const payload = [
-      (step == 'bw' ? 0x0F : 0x00) | ( i == 0 ? 0x00 : 0xF0),
+      flag | (i == 0 && !region ? 0x00 : 0xF0),
       ...data.slice(i, i + chunkSize),
     ];
-    if (noReplyCount > 0) {
-      await write(EpdCmd.WRITE_IMG, payload, false);
+    if (credits !== null) {
+      await waitCredit();
+      await write(cmd, payload, credits === null);
+    } else if (rxBusy) {
+      await new Promise(resolve => setTimeout(resolve, 200)); // 等设备处理完缓冲区中的数据
+      rxBusy = false;
+      await write(cmd, payload, true);
+      noReplyCount = interleavedCount;
+    } else if (noReplyCount > 0) {
+      await write(cmd, payload, false);
       noReplyCount--;
     } else {
-      await write(EpdCmd.WRITE_IMG, payload, true);
+      await write(cmd, payload, true);
       noReplyCount = interleavedCount;
     }
     chunkIdx++;
   }
+  const elapsed = Math.max(new Date().getTime() - writeStart, 1);
+  addLog(`发送 ${data.length} 字节，用时 ${elapsed}ms，速度 ${(data.length / 1.024 / elapsed).toFixed(1)} KB/s`);
 }
 
 async function setDriver() {
@@ -134,6 +278,25 @@ async function clearScreen() {
   }
 }
 
+async function readStats() {
+  const reset = confirm('读取后是否清零统计数据?');
+  await write(EpdCmd.GET_STATS, [reset ? 1 : 0]);
+}
+
+function handleStats(data) {
+  const offset = data[1];
+  statsData.set(data.slice(2, 2 + statsData.length - offset), offset);
+  if (offset + data.length - 2 < statsData.length) return;
+
+  const view = new DataView(statsData.buffer);
+  const stat = (i) => view.getUint32(i * 4, true);
+  addLog(`SPI 字节: ${stat(0)}, 命令数: ${stat(1)}, 刷新次数: ${stat(5)}`, '⇓');
+  addLog(`BUSY 等待: ${stat(2)} 次, 共 ${stat(3)}ms, 最长 ${stat(4)}ms`, '⇓');
+  addLog(`全屏更新: ${stat(6)}ms, 局部更新: ${stat(7)}ms`, '⇓');
+  addLog(`上次刷新耗时: 全刷 ${stat(8)}ms, 快刷 ${stat(9)}ms`, '⇓');
+  addLog(`接收缓冲区最高占用: ${stat(10)} 字节`, '⇓');
+}
+
 async function sendcmd() {
   const cmdTXT = document.getElementById('cmdTXT').value;
   if (cmdTXT == '') return;
@@ -148,6 +311,7 @@ async function sendimg() {
 
   startTime = new Date().getTime();
   status.parentElement.style.display = "block";
+  let refreshMode = null;
 
   if (appVersion < 0x16) {
     if (mode.startsWith('bwr')) {
@@ -157,11 +321,32 @@ async function sendimg() {
       await epdWrite(driver === "04" ? 0x24 : 0x13, canvas2bytes(canvas, 'bw'));
     }
   } else {
-    await epdWriteImage('bw');
-    if (mode.startsWith('bwr')) await epdWriteImage('red');
+    const diff = appVersion >= 0x19 && !mode.startsWith('bwr') && document.getElementById('diffrefresh').checked;
+    if (mode === 'gray' && appVersion >= 0x1A) {
+      // 2 bit planes go to RAM1 and RAM2
+      await epdWriteImage('gray1');
+      await epdWriteImage('gray2');
+      refreshMode = [0x04];
+    } else if (appVersion >= 0x1F && getRegion()) {
+      // 只发送区域的数据并局刷该区域
+      const region = getRegion();
+      if (driver === '01') {
+        // UC8176 黑白屏的局刷 LUT: DTM2 为新图像，DTM1 为反色的新图像
+        await epdWriteImage('bw', region, 1);
+        await epdWriteImage('bw', region, 0, true);
+      } else {
+        await epdWriteImage('bw', region);
+        if (mode.startsWith('bwr')) await epdWriteImage('red', region);
+      }
+      refreshMode = [0x01];
+    } else {
+      await epdWriteImage('bw'); // 差分刷新时屏幕内存中保留着上一帧
+      if (mode.startsWith('bwr')) await epdWriteImage('red');
+      if (diff) refreshMode = [0x03];
+    }
   }
 
-  await write(EpdCmd.REFRESH);
+  await write(EpdCmd.REFRESH, refreshMode);
 
   const sendTime = (new Date().getTime() - startTime) / 1000.0;
   addLog(`发送完成！耗时: ${sendTime}s`);
@@ -177,6 +362,7 @@ function updateButtonStatus() {
   const status = connected ? null : 'disabled';
   document.getElementById("reconnectbutton").disabled = (gattServer == null || gattServer.connected) ? 'disabled' : null;
   document.getElementById("sendcmdbutton").disabled = status;
+  document.getElementById("statsbutton").disabled = status;
   document.getElementById("calendarmodebutton").disabled = status;
   document.getElementById("clockmodebutton").disabled = status;
   document.getElementById("clearscreenbutton").disabled = status;
@@ -229,7 +415,14 @@ async function reConnect() {
 
 function handleNotify(value, idx) {
   const data = new Uint8Array(value.buffer, value.byteOffset, value.byteLength);
-  if (idx == 0) {
+  if (data.length == 2 && data[0] == EpdCmd.FLOW_CTRL) {
+    if (credits === null) {
+      if (data[1] == 0) rxBusy = true;
+      return;
+    }
+    credits += data[1];
+    if (creditWaiter && credits > 0) creditWaiter(true);
+  } else if (idx == 0) {
     addLog(`收到配置：${bytes2hex(data)}`);
     const epdpins = document.getElementById("epdpins");
     const epddriver = document.getElementById("epddriver");
@@ -237,6 +430,13 @@ function handleNotify(value, idx) {
     if (data.length > 10) epdpins.value += bytes2hex(data.slice(10, 11));
     epddriver.value = bytes2hex(data.slice(7, 8));
     filterDitheringOptions();
+  } else if (data.length > 2 && data[0] == EpdCmd.GET_STATS) {
+    handleStats(data);
+  } else if (data[0] == EpdCmd.RAM_CRC && ramChecksum) {
+    handleRamChecksum(data);
+  } else if (data.length == 5 && data[0] == EpdCmd.REFRESH) {
+    const elapsed = ((data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4]) >>> 0;
+    addLog(`刷新完成，用时: ${elapsed}ms`, '⇓');
   } else {
     if (textDecoder == null) textDecoder = new TextDecoder();
     addLog(textDecoder.decode(data), '⇓');
@@ -282,6 +482,10 @@ async function connect() {
   }
 
   await write(EpdCmd.INIT);
+  if (appVersion >= 0x20) {
+    credits = 0;
+    await write(EpdCmd.FLOW_CTRL);
+  }
 
   document.getElementById("connectbutton").innerHTML = '断开';
   updateButtonStatus();
@@ -373,6 +577,8 @@ function convert_dithering() {
 
   if (mode.startsWith('bwr')) {
     ditheringCanvasByPalette(canvas, bwrPalette, mode);
+  } else if (mode === 'gray') {
+    dithering(ctx, canvas.width, canvas.height, 4, mode); // 4 levels
   } else {
     dithering(ctx, canvas.width, canvas.height, parseInt(document.getElementById('threshold').value), mode);
   }
@@ -32,6 +32,7 @@
 #include "softdevice_handler.h"
 #endif
 #include "nrf_power.h"
+#include "nrf_delay.h"
 #include "app_error.h"
 #include "app_timer.h"
 #include "app_scheduler.h"
@@ -73,6 +74,8 @@
 #define MAX_CONN_INTERVAL                MSEC_TO_UNITS(30, UNIT_1_25_MS)                /**< Maximum connection interval (30 ms). */
 #define SLAVE_LATENCY                    6                                              /**< Slave latency. */
 #define CONN_SUP_TIMEOUT                 MSEC_TO_UNITS(430, UNIT_10_MS)                 /**< Connection supervisory timeout (430 ms). */
+#define BULK_CONN_INTERVAL               MSEC_TO_UNITS(7.5, UNIT_1_25_MS)               /**< Connection interval while an image is transferred (7.5 ms). */
+#define BULK_PROFILE_TIMEOUT             TIMER_TICKS(30000)                             /**< Longest time in the bulk transfer profile without a new image (ticks). */
 #define FIRST_CONN_PARAMS_UPDATE_DELAY   TIMER_TICKS(5000)                              /**< Time from initiating event (connect or start of notification) to first time sd_ble_gap_conn_param_update is called (5 seconds). */
 #define NEXT_CONN_PARAMS_UPDATE_DELAY    TIMER_TICKS(30000)                             /**< Time between each call to sd_ble_gap_conn_param_update after the first call (30 seconds). */
 #define MAX_CONN_PARAMS_UPDATE_COUNT     3                                              /**< Number of attempts before giving up the connection parameter negotiation. */
@@ -81,6 +84,7 @@
 #define SCHED_QUEUE_SIZE                10                                              /**< Maximum number of events in the scheduler queue. */
 
 #define CLOCK_TIMER_INTERVAL             TIMER_TICKS(1000)                              /**< Clock timer interval (ticks). */
+#define BATTERY_TIMER_INTERVAL           TIMER_TICKS(300000)                            /**< Battery voltage sampling interval (ticks). */
 
 #define DEAD_BEEF                        0xDEADBEEF                                     /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
@@ -91,12 +95,19 @@ BLE_ADVERTISING_DEF(m_advertising);
 static ble_dfu_t                         m_dfus;                                        /**< Structure used to identify the DFU service. */
 #endif
 static uint16_t                          m_conn_handle = BLE_CONN_HANDLE_INVALID;       /**< Handle of the current connection. */
+#if defined(S112)
+static bool                              m_bulk_transfer = false;                       /**< Connection is in the bulk transfer profile. */
+#endif
 static ble_uuid_t                        m_adv_uuids[] = {{BLE_UUID_EPD_SVC, \
                                                            EPD_SVC_UUID_TYPE}};         /**< Universally unique service identifier. */
 
 BLE_EPD_DEF(m_epd);                                                                     /**< Structure to identify the EPD Service. */
 static uint32_t                          m_timestamp = 1735689600;                      /**< Current timestamp. */
 APP_TIMER_DEF(m_clock_timer_id);                                                        /**< Clock timer. */
+APP_TIMER_DEF(m_battery_timer_id);                                                      /**< Battery sampling timer. */
+#if defined(S112)
+APP_TIMER_DEF(m_bulk_timer_id);                                                         /**< Leaves the bulk transfer profile if no refresh follows. */
+#endif
 static nrf_drv_wdt_channel_id            m_wdt_channel_id;
 static uint32_t                          m_wdt_last_feed_time = 0;
 static uint32_t                          m_resetreas;
@@ -241,6 +252,19 @@ static void clock_timer_timeout_handler(void * p_context)
     ble_epd_on_timer(&m_epd, m_timestamp, false);
 }
 
+static void battery_sample_handler(void * p_event_data, uint16_t event_size)
+{
+    // VDD sags while the panel is driven, keep the previous sample
+    if (!epd_refresh_busy()) EPD_VoltageSample();
+}
+
+static void battery_timer_timeout_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    app_sched_event_put(NULL, 0, battery_sample_handler);
+}
+
 /**@brief Function for the Event Scheduler initialization.
  */
 static void scheduler_init(void)
@@ -264,6 +288,9 @@ static void timers_init(void)
     APP_ERROR_CHECK(app_timer_create(&m_clock_timer_id,
                                      APP_TIMER_MODE_REPEATED,
                                      clock_timer_timeout_handler));
+    APP_ERROR_CHECK(app_timer_create(&m_battery_timer_id,
+                                     APP_TIMER_MODE_REPEATED,
+                                     battery_timer_timeout_handler));
 }
 
 /**@brief Function for starting application timers.
@@ -272,6 +299,7 @@ static void application_timers_start(void)
 {
     // Start application timers.
     APP_ERROR_CHECK(app_timer_start(m_clock_timer_id, CLOCK_TIMER_INTERVAL, NULL));
+    APP_ERROR_CHECK(app_timer_start(m_battery_timer_id, BATTERY_TIMER_INTERVAL, NULL));
 }
 
 /**@brief Function for putting the chip into sleep mode.
@@ -415,7 +443,7 @@ void gpiote_evt_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
 
     nrf_drv_gpiote_in_event_disable(pin);
     nrf_drv_gpiote_in_uninit(pin);
-    nrf_drv_gpiote_uninit();
+    epd_hal_gpiote_release(); // a BUSY wait may still use GPIOTE
 
     advertising_start();
 }
@@ -423,7 +451,7 @@ void gpiote_evt_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
 static void setup_wakeup_pin(nrf_drv_gpiote_pin_t pin) {
     NRF_LOG_DEBUG("Setting up wakeup pin\n");
 
-    APP_ERROR_CHECK(nrf_drv_gpiote_init());
+    epd_hal_gpiote_acquire(); // GPIOTE may be in use by an async refresh
     nrf_drv_gpiote_in_config_t config = GPIOTE_CONFIG_IN_SENSE_LOTOHI(false);
     APP_ERROR_CHECK(nrf_drv_gpiote_in_init(pin, &config, gpiote_evt_handler));
     nrf_drv_gpiote_in_event_enable(pin, true);
@@ -474,7 +502,10 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
         case BLE_GAP_EVT_DISCONNECTED:
             NRF_LOG_INFO("DISCONNECTED\n");
             m_conn_handle = BLE_CONN_HANDLE_INVALID;
-#if !defined(S112)
+#if defined(S112)
+            m_bulk_transfer = false;
+            app_timer_stop(m_bulk_timer_id);
+#else
             advertising_start();
 #endif
             break;
@@ -591,6 +622,12 @@ static void ble_stack_init(void)
 
     // Register a handler for BLE events.
     NRF_SDH_BLE_OBSERVER(m_ble_observer, APP_BLE_OBSERVER_PRIO, ble_evt_handler, NULL);
+
+    // Let connection events run past the event length while there is data to send.
+    ble_opt_t opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.common_opt.conn_evt_ext.enable = 1;
+    APP_ERROR_CHECK(sd_ble_opt_set(BLE_COMMON_OPT_CONN_EVT_EXT, &opt));
 #else
     nrf_clock_lf_cfg_t  clock_lf_cfg = NRF_CLOCK_LFCLKSRC;
 
@@ -632,11 +669,74 @@ void gatt_evt_handler(nrf_ble_gatt_t * p_gatt, nrf_ble_gatt_evt_t const * p_evt)
 }
 
 
+static void bulk_timeout_sched_handler(void * p_event_data, uint16_t event_size)
+{
+    conn_profile_bulk_exit();
+}
+
+static void bulk_timer_timeout_handler(void * p_context)
+{
+    app_sched_event_put(NULL, 0, bulk_timeout_sched_handler);
+}
+
 /**@brief Function for initializing the GATT library. */
 void gatt_init(void)
 {
     APP_ERROR_CHECK(nrf_ble_gatt_init(&m_gatt, gatt_evt_handler));
     APP_ERROR_CHECK(nrf_ble_gatt_att_mtu_periph_set(&m_gatt, NRF_SDH_BLE_GATT_MAX_MTU_SIZE));
+    APP_ERROR_CHECK(app_timer_create(&m_bulk_timer_id, APP_TIMER_MODE_SINGLE_SHOT, bulk_timer_timeout_handler));
+}
+
+/**@brief Request a connection profile, the central may still pick other parameters.
+ *
+ * @details The bulk profile asks for 2M PHY, the shortest interval and no slave
+ *          latency, the low power profile restores the preferred connection
+ *          parameters. The PHY is left at 2M, it keeps the radio on for less time
+ *          per packet. S112 has no data length extension. The bulk profile is
+ *          left after BULK_PROFILE_TIMEOUT if no refresh ends it before.
+ */
+static void conn_profile_set(bool bulk)
+{
+    ble_gap_conn_params_t conn_params;
+    uint32_t err_code;
+
+    // every image restarts the timeout, also when the profile is already active
+    app_timer_stop(m_bulk_timer_id);
+    if (bulk && m_conn_handle != BLE_CONN_HANDLE_INVALID)
+        APP_ERROR_CHECK(app_timer_start(m_bulk_timer_id, BULK_PROFILE_TIMEOUT, NULL));
+
+    if (m_conn_handle == BLE_CONN_HANDLE_INVALID || m_bulk_transfer == bulk) return;
+    m_bulk_transfer = bulk;
+    NRF_LOG_INFO("%s connection profile\n", bulk ? "bulk transfer" : "low power");
+
+    if (bulk)
+    {
+        ble_gap_phys_t const phys =
+        {
+            .rx_phys = BLE_GAP_PHY_2MBPS,
+            .tx_phys = BLE_GAP_PHY_2MBPS,
+        };
+        err_code = sd_ble_gap_phy_update(m_conn_handle, &phys);
+        if (err_code != NRF_SUCCESS) NRF_LOG_DEBUG("PHY update failed: %d\n", err_code);
+    }
+
+    memset(&conn_params, 0, sizeof(conn_params));
+    conn_params.min_conn_interval = bulk ? BULK_CONN_INTERVAL : MIN_CONN_INTERVAL;
+    conn_params.max_conn_interval = bulk ? BULK_CONN_INTERVAL : MAX_CONN_INTERVAL;
+    conn_params.slave_latency     = bulk ? 0 : SLAVE_LATENCY;
+    conn_params.conn_sup_timeout  = CONN_SUP_TIMEOUT;
+    err_code = ble_conn_params_change_conn_params(m_conn_handle, &conn_params);
+    if (err_code != NRF_SUCCESS) NRF_LOG_DEBUG("conn params update failed: %d\n", err_code);
+}
+
+void conn_profile_bulk_enter(void)
+{
+    conn_profile_set(true);
+}
+
+void conn_profile_bulk_exit(void)
+{
+    conn_profile_set(false);
 }
 #else
 // Set BW Config to HIGH.
@@ -4,3 +4,7 @@ uint32_t timestamp(void);
 void set_timestamp(uint32_t timestamp);
 void sleep_mode_enter(void);
 void app_feed_wdt(void);
+#if defined(S112)
+void conn_profile_bulk_enter(void);
+void conn_profile_bulk_exit(void);
+#endif